@@ -0,0 +1,196 @@
+#include "generator.hpp"
+
+#include <random>
+#include <string>
+
+namespace vanadium {
+namespace bench {
+
+const std::vector<WorkloadInfo> workloads = {
+    {Workload::Functions, "functions"}, {Workload::Nested, "nested"},
+    {Workload::Expressions, "expressions"}, {Workload::Comments, "comments"},
+    {Workload::Strings, "strings"}};
+
+namespace {
+
+class Generator {
+public:
+  Generator(const GeneratorOptions &options)
+      : options(options), rng(options.seed) {}
+
+  std::string run(Workload workload) {
+    while (out.size() < options.bytes) {
+      switch (workload) {
+      case Workload::Functions:
+        function();
+        break;
+      case Workload::Nested:
+        nested();
+        break;
+      case Workload::Expressions:
+        expressions();
+        break;
+      case Workload::Comments:
+        comments();
+        break;
+      case Workload::Strings:
+        strings();
+        break;
+      }
+      item++;
+    }
+    return std::move(out);
+  }
+
+private:
+  const GeneratorOptions &options;
+  std::mt19937 rng;
+  std::string out;
+  size_t item = 0;
+
+  size_t pick(size_t n) { return rng() % n; }
+  std::string id() { return std::to_string(item); }
+
+  void function() {
+    static const char *const types[] = {"int", "[4]int", "{str}int",
+                                        "float", "&str"};
+    out += "static func generated_" + id() + "(alpha: int, beta: " +
+           types[pick(5)] + ") : int {\n";
+    out += "  let total = alpha + beta * 42 - helper(alpha, \"text\");\n";
+    out += "  let field = value.member.field;\n";
+    out += "  const flag = total >= 10 and field != null;\n";
+    out += "  total += callback(field, 3.5, 0x" + std::to_string(pick(9000)) +
+           ");\n";
+    out += "}\n\n";
+  }
+
+  void block(size_t depth) {
+    std::string level = std::to_string(depth);
+    out += "{\n";
+    out += "let v" + level + " = " + level + ";\n";
+    if (depth < options.depth) {
+      out += "let w" + level + " = ";
+      block(depth + 1);
+      out += ";\n";
+    }
+    out += "v" + level + ";\n}";
+  }
+
+  void nested() {
+    out += "let nested_" + id() + " = ";
+    block(1);
+    out += ";\n";
+  }
+
+  void operand() {
+    switch (pick(6)) {
+    case 0:
+      out += "value_" + std::to_string(pick(100));
+      break;
+    case 1:
+      out += std::to_string(pick(100000));
+      break;
+    case 2:
+      out += "call_" + std::to_string(pick(10)) + "(x, " +
+             std::to_string(pick(10)) + ")";
+      break;
+    case 3:
+      out += "object.member_" + std::to_string(pick(10)) + ".inner";
+      break;
+    case 4:
+      out += "(a + " + std::to_string(pick(10)) + ")";
+      break;
+    default:
+      out += "-operand";
+      break;
+    }
+  }
+
+  void expressions() {
+    static const char *const ops[] = {" + ",  " - ",  " * ",   " / ",
+                                      " == ", " < ",  " >= ",  " and ",
+                                      " or ", " && ", " || ",  " << ",
+                                      " | ",  " & ",  " ^ ",   " != "};
+    out += "let chain_" + id() + " = ";
+    operand();
+    for (size_t i = 0; i < options.depth; i++) {
+      out += ops[pick(16)];
+      operand();
+    }
+    out += ";\n";
+  }
+
+  void comments() {
+    if (pick(4) == 0) {
+      out += "@* A block comment spanning\n   a few lines of prose, "
+             "with code-like text: let x = 1; *@\n";
+    } else {
+      out += "@@ Line comment number " + id() +
+             " explaining what the next statement does\n";
+    }
+    if (pick(3) == 0) {
+      out += "let commented_" + id() + " = " + std::to_string(pick(1000)) +
+             ";\n";
+    }
+  }
+
+  void strings() {
+    switch (pick(3)) {
+    case 0:
+      out += "let text_" + id() +
+             " = \"A plain string literal of moderate length, with "
+             "punctuation.\";\n";
+      break;
+    case 1:
+      out += "let escaped_" + id() +
+             " = \"Escapes: \\\"quoted\\\"\\n\\ttabbed \\\\ \\x41 "
+             "\\u{1F600}\";\n";
+      break;
+    default:
+      out += "print(\"first\", \"second argument\", \"" + id() + "\");\n";
+      break;
+    }
+  }
+};
+
+} // namespace
+
+std::string generate(Workload workload, const GeneratorOptions &options) {
+  return Generator(options).run(workload);
+}
+
+const std::vector<std::pair<Nesting, std::string_view>> nestings = {
+    {Nesting::Parens, "parens"},
+    {Nesting::Unary, "unary"},
+    {Nesting::Blocks, "blocks"},
+    {Nesting::Types, "types"},
+    {Nesting::Assignments, "assignments"}};
+
+static std::string repeat(std::string_view piece, size_t times) {
+  std::string out;
+  out.reserve(piece.size() * times);
+  for (size_t i = 0; i < times; i++) {
+    out += piece;
+  }
+  return out;
+}
+
+std::string generate_nested(Nesting nesting, size_t depth) {
+  switch (nesting) {
+  case Nesting::Parens:
+    return "let x = " + repeat("(", depth) + "1" + repeat(")", depth) + ";\n";
+  case Nesting::Unary:
+    return "let x = " + repeat("- ", depth) + "1;\n";
+  case Nesting::Blocks:
+    return "let x = " + repeat("{ ", depth) + "1;" + repeat(" };", depth) +
+           "\n";
+  case Nesting::Types:
+    return "func f(a: " + repeat("[]", depth) + "int) { }\n";
+  case Nesting::Assignments:
+    return "let x = a" + repeat(" = a", depth) + ";\n";
+  }
+  return "";
+}
+
+} // namespace bench
+} // namespace vanadium
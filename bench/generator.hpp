@@ -0,0 +1,71 @@
+#ifndef BENCH_GENERATOR_HPP_
+#define BENCH_GENERATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace vanadium {
+namespace bench {
+
+// Shapes of synthetic source, each stressing a different part of the
+// lexer and parser
+enum class Workload {
+  // Many small functions with typical statements
+  Functions,
+  // Blocks nested `depth` levels deep
+  Nested,
+  // Long chains of binary operators, calls and member accesses
+  Expressions,
+  // Mostly line and block comments
+  Comments,
+  // Mostly string literals, some with escapes
+  Strings,
+};
+
+struct WorkloadInfo {
+  Workload workload;
+  std::string_view name;
+};
+
+extern const std::vector<WorkloadInfo> workloads;
+
+struct GeneratorOptions {
+  // The output is cut at the first item boundary past this size
+  size_t bytes = 4 * 1024 * 1024;
+  // Nesting depth of Nested, and operators per chain of Expressions
+  size_t depth = 64;
+  uint32_t seed = 1;
+};
+
+// Generates syntactically valid Vanadium source of the given shape. The
+// same options always give the same source.
+std::string generate(Workload workload, const GeneratorOptions &options);
+
+// A single construct nested into itself, for checking that parsing stays
+// linear (and does not overflow the stack) as nesting grows
+enum class Nesting {
+  // ((((1))))
+  Parens,
+  // - - - - 1
+  Unary,
+  // { { { 1; }; }; }
+  Blocks,
+  // [][][][]int
+  Types,
+  // a = a = a = a
+  Assignments,
+};
+
+extern const std::vector<std::pair<Nesting, std::string_view>> nestings;
+
+// One declaration nesting the construct `depth` levels deep
+std::string generate_nested(Nesting nesting, size_t depth);
+
+} // namespace bench
+} // namespace vanadium
+
+#endif // BENCH_GENERATOR_HPP_
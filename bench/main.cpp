@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "generator.hpp"
+#include "memory.hpp"
+#include "vanadium/parser/ast.hpp"
+#include "vanadium/parser/ast_dumper.hpp"
+#include "vanadium/parser/ast_visitor.hpp"
+#include "vanadium/parser/errors.hpp"
+#include "vanadium/parser/flat_ast.hpp"
+#include "vanadium/parser/lexer.hpp"
+#include "vanadium/parser/parser.hpp"
+
+// Lexer and parser throughput on synthetic sources. Prints one JSON object
+// per workload and line, so runs can be compared across commits.
+
+using namespace vanadium;
+
+struct BenchOptions {
+  bench::GeneratorOptions generator;
+  std::vector<bench::Workload> workloads;
+  unsigned repeat = 3;
+  unsigned jobs = 1;
+  bool emit = false;
+  bool scaling = false;
+};
+
+// Nodes of each kind reachable from the top-level ones, bodies included
+struct NodeCounter : parser::ASTVisitor<NodeCounter> {
+  std::array<size_t, 256> by_kind{};
+
+  void visit_node(parser::NodeP node) {
+    by_kind[static_cast<uint8_t>(node->kind)]++;
+    visit_children(node);
+  }
+};
+
+static size_t count_all(const std::vector<parser::NodeP> &nodes) {
+  NodeCounter counter;
+  for (parser::NodeP node : nodes) {
+    counter.walk(node);
+  }
+  return std::accumulate(counter.by_kind.begin(), counter.by_kind.end(),
+                         size_t(0));
+}
+
+// The same count over the flat encoding, one pass along its tags
+static size_t count_flat(const parser::FlatAst &ast) {
+  std::array<size_t, 256> by_kind{};
+  for (size_t i = 0; i < ast.size(); i++) {
+    by_kind[static_cast<uint8_t>(ast.tag(i))]++;
+  }
+  return std::accumulate(by_kind.begin(), by_kind.end(), size_t(0));
+}
+
+static void keep_min(double &best, double sample, unsigned run) {
+  if (run == 0 || sample < best) {
+    best = sample;
+  }
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - since)
+      .count();
+}
+
+static void run(const bench::WorkloadInfo &info, const BenchOptions &options) {
+  std::string source = bench::generate(info.workload, options.generator);
+
+  double lex_ms = 0;
+  double parse_ms = 0;
+  size_t lex_peak = 0;
+  size_t parse_peak = 0;
+  size_t tokens = 0;
+  size_t nodes = 0;
+  size_t ast_bytes = 0;
+  double tree_walk_ms = 0;
+  double flatten_ms = 0;
+  double flat_walk_ms = 0;
+  size_t flat_bytes = 0;
+  double dump_ms = 0;
+  // The dump is timed without the cost of keeping it
+  int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+  for (unsigned i = 0; i < options.repeat; i++) {
+    size_t base = bench::live_bytes();
+    bench::reset_peak();
+    auto start = std::chrono::steady_clock::now();
+    lexer::TokenStream ts = lexer::tokenize(source);
+    double lexed = elapsed_ms(start);
+    size_t lexed_peak = bench::peak_bytes() - base;
+
+    parser::ParseOptions parse_options;
+    parse_options.jobs = options.jobs;
+    parser::Parser p(ts, parse_options);
+
+    base = bench::live_bytes();
+    bench::reset_peak();
+    start = std::chrono::steady_clock::now();
+    parser::NodeStream ast = p.parse();
+    double parsed = elapsed_ms(start);
+    size_t parsed_peak = bench::peak_bytes() - base;
+
+    start = std::chrono::steady_clock::now();
+    nodes = count_all(ast.get_nodes());
+    keep_min(tree_walk_ms, elapsed_ms(start), i);
+
+    start = std::chrono::steady_clock::now();
+    parser::FlatAst flat = parser::flatten(ast.get_nodes());
+    keep_min(flatten_ms, elapsed_ms(start), i);
+
+    start = std::chrono::steady_clock::now();
+    if (count_flat(flat) != nodes) {
+      throw std::logic_error("The flat AST lost nodes");
+    }
+    keep_min(flat_walk_ms, elapsed_ms(start), i);
+
+    parser::DumpOptions dump_options;
+    dump_options.format = parser::DumpFormat::Json;
+    start = std::chrono::steady_clock::now();
+    {
+      parser::AstDumper dumper(null_fd, dump_options);
+      dumper.dump(flat);
+      dumper.flush();
+    }
+    keep_min(dump_ms, elapsed_ms(start), i);
+
+    keep_min(lex_ms, lexed, i);
+    keep_min(parse_ms, parsed, i);
+    lex_peak = std::max(lex_peak, lexed_peak);
+    parse_peak = std::max(parse_peak, parsed_peak);
+    tokens = ts.get_tokens().size();
+    // The arena maps its memory directly, out of sight of the peak counter
+    ast_bytes = ast.get_arena()->bytes_mapped();
+    flat_bytes = flat.bytes();
+  }
+  close(null_fd);
+
+  std::printf("{\"workload\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, "
+              "\"nodes\": %zu, \"lex_ms\": %.3f, \"lex_mb_per_s\": %.1f, "
+              "\"lex_tokens_per_s\": %.0f, \"lex_peak_bytes\": %zu, "
+              "\"parse_ms\": %.3f, \"parse_nodes_per_s\": %.0f, "
+              "\"parse_tokens_per_s\": %.0f, \"parse_peak_bytes\": %zu, "
+              "\"ast_arena_bytes\": %zu, \"tree_walk_ms\": %.3f, "
+              "\"flatten_ms\": %.3f, \"flat_walk_ms\": %.3f, "
+              "\"flat_bytes\": %zu, \"dump_ms\": %.3f}\n",
+              std::string(info.name).c_str(), source.size(), tokens, nodes,
+              lex_ms, source.size() / 1e3 / lex_ms, tokens * 1e3 / lex_ms,
+              lex_peak, parse_ms, nodes * 1e3 / parse_ms,
+              tokens * 1e3 / parse_ms, parse_peak, ast_bytes, tree_walk_ms,
+              flatten_ms, flat_walk_ms, flat_bytes, dump_ms);
+  std::fflush(stdout);
+}
+
+// Parses each nesting shape at growing depths. Time per level should stay
+// flat from one depth to the next.
+static void run_scaling(const BenchOptions &options) {
+  static const size_t depths[] = {1000, 10000, 100000};
+
+  for (const auto &nesting : bench::nestings) {
+    for (size_t depth : depths) {
+      std::string source = bench::generate_nested(nesting.first, depth);
+      lexer::TokenStream ts = lexer::tokenize(source);
+
+      double parse_ms = 0;
+      double destroy_ms = 0;
+      for (unsigned i = 0; i < options.repeat; i++) {
+        auto start = std::chrono::steady_clock::now();
+        auto ast =
+            std::make_unique<parser::NodeStream>(parser::Parser(ts).parse());
+        double parsed = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        ast.reset();
+        double destroyed = elapsed_ms(start);
+
+        keep_min(parse_ms, parsed, i);
+        keep_min(destroy_ms, destroyed, i);
+      }
+
+      std::printf("{\"nesting\": \"%s\", \"depth\": %zu, "
+                  "\"parse_ms\": %.3f, \"parse_ns_per_level\": %.1f, "
+                  "\"destroy_ms\": %.3f}\n",
+                  std::string(nesting.second).c_str(), depth, parse_ms,
+                  parse_ms * 1e6 / depth, destroy_ms);
+      std::fflush(stdout);
+    }
+  }
+}
+
+static void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0
+            << " [--size=MB] [--depth=N] [--seed=N] [--repeat=N] [--jobs=N]"
+               " [--workload=NAME]... [--emit] [--scaling]\n"
+               "workloads:";
+  for (const auto &info : bench::workloads) {
+    std::cerr << " " << info.name;
+  }
+  std::cerr << std::endl;
+}
+
+static bool parse_args(int argc, char *argv[], BenchOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+    if (name == "--size") {
+      options.generator.bytes = std::strtod(value.c_str(), nullptr) * 1e6;
+    } else if (name == "--depth") {
+      options.generator.depth = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "--seed") {
+      options.generator.seed = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "--repeat") {
+      options.repeat =
+          std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+    } else if (name == "--jobs") {
+      options.jobs = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "--emit") {
+      options.emit = true;
+    } else if (name == "--scaling") {
+      options.scaling = true;
+    } else if (name == "--workload") {
+      auto found = std::find_if(
+          bench::workloads.begin(), bench::workloads.end(),
+          [&](const bench::WorkloadInfo &info) { return info.name == value; });
+      if (found == bench::workloads.end()) {
+        return false;
+      }
+      options.workloads.push_back(found->workload);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  BenchOptions options;
+  if (!parse_args(argc, argv, options)) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (options.workloads.empty()) {
+    for (const auto &info : bench::workloads) {
+      options.workloads.push_back(info.workload);
+    }
+  }
+
+  // --emit prints the generated source instead of measuring it
+  if (options.emit) {
+    for (auto workload : options.workloads) {
+      std::cout << bench::generate(workload, options.generator);
+    }
+    return 0;
+  }
+
+  // --scaling measures deep nesting instead of the workloads
+  if (options.scaling) {
+    try {
+      run_scaling(options);
+    } catch (const parser::ParseError &e) {
+      std::cerr << "scaling: " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  for (const auto &info : bench::workloads) {
+    if (std::find(options.workloads.begin(), options.workloads.end(),
+                  info.workload) == options.workloads.end()) {
+      continue;
+    }
+    try {
+      run(info, options);
+    } catch (const parser::ParseError &e) {
+      std::cerr << info.name << ": " << e.what() << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
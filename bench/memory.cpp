@@ -0,0 +1,57 @@
+#include "memory.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace vanadium {
+namespace bench {
+
+static std::atomic<size_t> live{0};
+static std::atomic<size_t> peak{0};
+
+size_t live_bytes() { return live.load(); }
+size_t peak_bytes() { return peak.load(); }
+void reset_peak() { peak.store(live.load()); }
+
+// Every block is prefixed with its size, padded to keep the alignment
+// malloc guarantees
+static constexpr size_t header = alignof(std::max_align_t);
+
+static void *allocate(size_t size) {
+  void *block = std::malloc(size + header);
+  if (!block) {
+    throw std::bad_alloc();
+  }
+  *static_cast<size_t *>(block) = size;
+
+  size_t now = live.fetch_add(size) + size;
+  size_t seen = peak.load();
+  while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+  }
+  return static_cast<char *>(block) + header;
+}
+
+static void deallocate(void *p) {
+  if (!p) {
+    return;
+  }
+  void *block = static_cast<char *>(p) - header;
+  live.fetch_sub(*static_cast<size_t *>(block));
+  std::free(block);
+}
+
+} // namespace bench
+} // namespace vanadium
+
+void *operator new(size_t size) { return vanadium::bench::allocate(size); }
+void *operator new[](size_t size) { return vanadium::bench::allocate(size); }
+void operator delete(void *p) noexcept { vanadium::bench::deallocate(p); }
+void operator delete[](void *p) noexcept { vanadium::bench::deallocate(p); }
+void operator delete(void *p, size_t) noexcept {
+  vanadium::bench::deallocate(p);
+}
+void operator delete[](void *p, size_t) noexcept {
+  vanadium::bench::deallocate(p);
+}
@@ -0,0 +1,20 @@
+#ifndef BENCH_MEMORY_HPP_
+#define BENCH_MEMORY_HPP_
+
+#include <cstddef>
+
+namespace vanadium {
+namespace bench {
+
+// Heap usage through the global operator new, which the bench replaces
+
+size_t live_bytes();
+size_t peak_bytes();
+
+// Starts a new peak at the current usage
+void reset_peak();
+
+} // namespace bench
+} // namespace vanadium
+
+#endif // BENCH_MEMORY_HPP_
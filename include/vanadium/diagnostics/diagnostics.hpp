@@ -1,6 +1,7 @@
 #ifndef INCLUDE_DIAGNOSTICS_DIAGNOSTICS_HPP_
 #define INCLUDE_DIAGNOSTICS_DIAGNOSTICS_HPP_
 
+#include "vanadium/source/source_manager.hpp"
 #include <iostream>
 #include <ostream>
 #include <string>
@@ -26,6 +27,9 @@ struct Label {
       : message(msg), title(title) {
     has_pos = false;
   }
+  // Titled with the file name, positioned at `offset` within it
+  Label(const std::string &msg, const source::SourceManager &sources,
+        source::FileID file, size_t offset);
 
   const bool has_pos_info() const { return has_pos; }
 
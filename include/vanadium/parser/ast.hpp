@@ -2,16 +2,23 @@
 #define INCLUDE_PARSER_AST_HPP_
 
 #include "vanadium/diagnostics/colors.hpp"
+#include "vanadium/parser/ast_arena.hpp"
 #include "vanadium/parser/lexer.hpp"
+#include "vanadium/symbol.hpp"
+#include <cassert>
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace vanadium {
 namespace parser {
 
-enum class NodeKind {
+enum class NodeKind : uint8_t {
   Include,
   Block,
   FuncDecl,
@@ -26,7 +33,8 @@ enum class NodeKind {
   ImplicitReturn,
   NewExpr,
   Throw,
-  UnlessExpr
+  UnlessExpr,
+  Error
 };
 
 const std::map<NodeKind, std::string> node_kind_map = {
@@ -43,232 +51,238 @@ const std::map<NodeKind, std::string> node_kind_map = {
     {NodeKind::Type, "Type"},
     {NodeKind::ImplicitReturn, "ImplicitReturn"},
     {NodeKind::NewExpr, "NewExpr"},
-    {NodeKind::Throw, "Throw"}};
+    {NodeKind::Throw, "Throw"},
+    {NodeKind::UnlessExpr, "UnlessExpr"},
+    {NodeKind::Error, "Error"}};
 
 extern std::string node_kind_as_string(NodeKind kind);
 
+class Node;
+// Nodes live in the AstArena of their compilation unit, and handles to them
+// are only good while it is
+typedef Node *NodeP;
+
 class Node {
 public:
-  NodeKind kind;
-  virtual ~Node() = default;
-
-  virtual const std::string as_string() {
-    return "Node(\n"
-           "    Kind: '" +
-           node_kind_as_string(kind) +
-           "'\n"
-           ")";
-  }
+  // Set once by the concrete node's constructor. Use isa<>, cast<> and
+  // dyn_cast<> below rather than testing it by hand.
+  const NodeKind kind;
+  // Source offset of the node's main token: its operator, keyword, opening
+  // bracket or first token
+  uint32_t pos = 0;
+
+  // The node and what it holds, written by an AstDumper in its Text format
+  const std::string as_string();
+
+protected:
+  explicit Node(NodeKind kind) : kind(kind) {}
+  // The arena frees nodes without destroying them
+  ~Node() = default;
 };
 
-typedef std::shared_ptr<Node> NodeP;
+// Whether `node` is a `T`, going by its kind. Every node class has a
+// `classof()` telling its kind apart.
+template <typename T> inline bool isa(const Node *node) {
+  return T::classof(node);
+}
+
+// `node` as the `T` it is known to be
+template <typename T> inline T *cast(Node *node) {
+  assert(isa<T>(node) && "cast<>() to the wrong node class");
+  return static_cast<T *>(node);
+}
+template <typename T> inline const T *cast(const Node *node) {
+  assert(isa<T>(node) && "cast<>() to the wrong node class");
+  return static_cast<const T *>(node);
+}
+
+// `node` as a `T`, or null if it is something else or null
+template <typename T> inline T *dyn_cast(Node *node) {
+  return node && isa<T>(node) ? static_cast<T *>(node) : nullptr;
+}
+template <typename T> inline const T *dyn_cast(const Node *node) {
+  return node && isa<T>(node) ? static_cast<const T *>(node) : nullptr;
+}
 
 class IncludeNode : public Node {
 public:
-  IncludeNode(std::string from, std::vector<std::string> includes)
-      : from(from), includes(includes) {}
-
-  const NodeKind kind = NodeKind::Include;
-  std::string from;
-  std::vector<std::string> includes;
-
-  const std::string as_string() override {
-    std::string joined_includes;
-    for (size_t i = 0; i < includes.size(); ++i) {
-      joined_includes += "'" + includes[i] + "'";
-      if (i + 1 < includes.size())
-        joined_includes += ",\n        ";
-    }
-
-    return "Node(Kind: '" + node_kind_as_string(kind) + "', From: '" + from +
-           "', Includes: [" + joined_includes + "])";
+  IncludeNode(std::string_view from, ArenaSpan<Symbol> includes)
+      : Node(NodeKind::Include), from(from), includes(includes) {}
+
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::Include;
   }
+
+  std::string_view from;
+  ArenaSpan<Symbol> includes;
 };
 
 class BlockNode : public Node {
 public:
-  BlockNode(std::vector<NodeP> inner) : inner(inner) {}
+  BlockNode(ArenaSpan<NodeP> inner) : Node(NodeKind::Block), inner(inner) {}
 
-  const NodeKind kind = NodeKind::Block;
-  std::vector<NodeP> inner;
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::Block;
+  }
 
-  const std::string as_string() override {
-    std::string joined_inner;
-    for (const auto &node : inner)
-      joined_inner += "  " + node->as_string() + ",\n";
+  ArenaSpan<NodeP> inner;
+};
 
-    return "Node(Kind: '" + node_kind_as_string(kind) + "', Inner: [\n" +
-           joined_inner + "])";
-  }
+// A subtree the parser skipped over, parsed by `parse` into an arena of
+// its own when first asked for. Safe to get from several threads.
+class DeferredNode {
+public:
+  explicit DeferredNode(
+      std::function<NodeP(const std::shared_ptr<AstArena> &)> parse)
+      : parse(std::move(parse)) {}
+
+  // Throws the parse's error, if any, on every call
+  NodeP get();
+  bool is_parsed();
+
+private:
+  std::mutex lock;
+  std::function<NodeP(const std::shared_ptr<AstArena> &)> parse;
+  std::shared_ptr<AstArena> arena;
+  NodeP node = nullptr;
 };
 
 class FuncDeclNode : public Node {
 public:
-  FuncDeclNode(std::string name, std::vector<lexer::TokenType> modifiers,
-               NodeP block, std::vector<std::pair<std::string, NodeP>> params,
+  FuncDeclNode(Symbol name, ArenaSpan<lexer::TokenType> modifiers,
+               NodeP block, ArenaSpan<std::pair<Symbol, NodeP>> params,
                NodeP ret_type)
-      : name(name), modfs(modifiers), block(block), parameters(params),
-        ret_type(ret_type) {}
-
-  const NodeKind kind = NodeKind::FuncDecl;
-  NodeP block;
-  std::vector<lexer::TokenType> modfs;
-  std::vector<std::pair<std::string, NodeP>> parameters;
-  std::string name;
-  NodeP ret_type;
+      : Node(NodeKind::FuncDecl), modfs(modifiers), parameters(params),
+        name(name), ret_type(ret_type), block(block) {}
+  FuncDeclNode(Symbol name, ArenaSpan<lexer::TokenType> modifiers,
+               DeferredNode *block, ArenaSpan<std::pair<Symbol, NodeP>> params,
+               NodeP ret_type)
+      : Node(NodeKind::FuncDecl), modfs(modifiers), parameters(params),
+        name(name), ret_type(ret_type), deferred_block(block) {}
 
-  const std::string as_string() override {
-    std::string joined_modfs = "[";
-    for (size_t i = 0; i < modfs.size(); ++i) {
-      joined_modfs += "'" + lexer::type_as_string(modfs[i]) + "'";
-      if (i + 1 < modfs.size())
-        joined_modfs += ",\n        ";
-    }
-    joined_modfs += "]";
-
-    std::string joined_params;
-    if (parameters.size() > 0) {
-      for (size_t i = 0; i < parameters.size(); ++i) {
-        joined_params +=
-            parameters[i].first + ": " + parameters[i].second->as_string();
-        if (i + 1 < parameters.size())
-          joined_params += ", ";
-      }
-    } else {
-      joined_params = "None";
-    }
-
-    return "Node(Kind: '" + node_kind_as_string(kind) + "', Name: '" + name +
-           "', Modifiers: " + joined_modfs + ", Block: " + block->as_string() +
-           ", Params: " + joined_params +
-           ", Returns: " + ret_type->as_string() + ")";
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::FuncDecl;
   }
+
+  ArenaSpan<lexer::TokenType> modfs;
+  ArenaSpan<std::pair<Symbol, NodeP>> parameters;
+  Symbol name;
+  NodeP ret_type;
+
+  // The body, which a parser skipping bodies only parses now
+  NodeP get_block() { return block ? block : deferred_block->get(); }
+  bool is_block_parsed() { return block || deferred_block->is_parsed(); }
+
+private:
+  NodeP block = nullptr;
+  // Owned by the arena
+  DeferredNode *deferred_block = nullptr;
 };
 
 class VarDeclNode : public Node {
 public:
-  VarDeclNode(std::string name, NodeP value,
-              std::vector<lexer::TokenType> modifiers, bool is_const,
-              bool is_static)
-      : name(name), value(value), modfs(modifiers), is_const(is_const),
-        is_static(is_static) {}
+  VarDeclNode(Symbol name, NodeP value, ArenaSpan<lexer::TokenType> modifiers,
+              bool is_const, bool is_static)
+      : Node(NodeKind::VarDecl), name(name), value(value), modfs(modifiers),
+        is_const(is_const), is_static(is_static) {}
+
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::VarDecl;
+  }
 
-  const NodeKind kind = NodeKind::VarDecl;
   NodeP value;
-  std::vector<lexer::TokenType> modfs;
-  std::string name;
+  ArenaSpan<lexer::TokenType> modfs;
+  Symbol name;
   bool is_const;
   bool is_static;
-
-  const std::string as_string() override {
-    std::string joined_modfs = "[";
-    for (size_t i = 0; i < modfs.size(); ++i) {
-      joined_modfs += "'" + lexer::type_as_string(modfs[i]) + "'";
-      if (i + 1 < modfs.size())
-        joined_modfs += ",\n        ";
-    }
-    joined_modfs += "]";
-
-    return "Node(Kind: '" + node_kind_as_string(kind) + "', Name: '" + name +
-           "', Value: " + value->as_string() + ", Modifiers: " + joined_modfs +
-           ", Constant: " + (is_const ? "yes" : "no") +
-           ", Static: " + (is_static ? "yes" : "no") + ")";
-  }
 };
 
 class BinaryExprNode : public Node {
 public:
-  BinaryExprNode(NodeP lhs, std::string op, NodeP rhs)
-      : lhs(lhs), op(op), rhs(rhs) {}
+  BinaryExprNode(NodeP lhs, std::string_view op, NodeP rhs)
+      : Node(NodeKind::BinaryExpr), lhs(lhs), op(op), rhs(rhs) {}
+
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::BinaryExpr;
+  }
 
-  const NodeKind kind = NodeKind::BinaryExpr;
   NodeP lhs;
   NodeP rhs;
-  std::string op;
-
-  const std::string as_string() override {
-    return "Node(Kind: '" + node_kind_as_string(kind) +
-           "', Left: " + lhs->as_string() + ", Right: " + rhs->as_string() +
-           ", Operator: '" + op + "')";
-  }
+  std::string_view op;
 };
 
 class UnaryExprNode : public Node {
 public:
-  UnaryExprNode(std::string op, NodeP operand) : op(op), operand(operand) {}
-
-  const NodeKind kind = NodeKind::UnaryExpr;
-  std::string op;
-  NodeP operand;
+  UnaryExprNode(std::string_view op, NodeP operand)
+      : Node(NodeKind::UnaryExpr), op(op), operand(operand) {}
 
-  const std::string as_string() override {
-    return "Node(Kind: '" + node_kind_as_string(kind) + "', Operator: '" + op +
-           "', Operand: " + operand->as_string() + ")";
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::UnaryExpr;
   }
+
+  std::string_view op;
+  NodeP operand;
 };
 
 class LiteralNode : public Node {
 public:
-  LiteralNode(std::string value, lexer::TokenType type)
-      : value(value), type(type) {}
+  LiteralNode(std::string_view value, lexer::TokenType type)
+      : Node(NodeKind::Literal), value(value), type(type) {}
+  LiteralNode(std::string_view value, lexer::TokenType type,
+              lexer::NumberValue number)
+      : Node(NodeKind::Literal), value(value), type(type), number(number) {}
+
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::Literal;
+  }
 
-  const NodeKind kind = NodeKind::Literal;
-  std::string value;
+  // A view into the source, or for strings with escapes into the
+  // compilation's StringArena
+  std::string_view value;
   lexer::TokenType type;
-
-  const std::string as_string() override {
-    return "Node(Kind: '" + node_kind_as_string(kind) + "', Type: '" +
-           lexer::type_as_string(type) + "', Value: '" + value + "')";
-  }
+  // Decoded value of Int and Float literals
+  lexer::NumberValue number;
 };
 
 class CallExprNode : public Node {
 public:
-  CallExprNode(NodeP callee, std::vector<NodeP> args)
-      : callee(callee), args(args) {}
-
-  const NodeKind kind = NodeKind::CallExpr;
-  NodeP callee;
-  std::vector<NodeP> args;
+  CallExprNode(NodeP callee, ArenaSpan<NodeP> args)
+      : Node(NodeKind::CallExpr), callee(callee), args(args) {}
 
-  const std::string as_string() override {
-    std::string joined_args;
-    for (const auto &arg : args)
-      joined_args += "  " + arg->as_string() + ",\n";
-
-    return "Node(Kind: '" + node_kind_as_string(kind) +
-           "', Callee: " + callee->as_string() + ", Args: [\n" + joined_args +
-           "])";
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::CallExpr;
   }
+
+  NodeP callee;
+  ArenaSpan<NodeP> args;
 };
 
 class MemberAccessNode : public Node {
 public:
-  MemberAccessNode(NodeP object, std::string member)
-      : object(object), member(member) {}
-
-  const NodeKind kind = NodeKind::MemberAccess;
-  NodeP object;
-  std::string member;
+  MemberAccessNode(NodeP object, Symbol member)
+      : Node(NodeKind::MemberAccess), object(object), member(member) {}
 
-  const std::string as_string() override {
-    return "Node(Kind: '" + node_kind_as_string(kind) +
-           "', Object: " + object->as_string() + ", Member: '" + member + "')";
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::MemberAccess;
   }
+
+  NodeP object;
+  Symbol member;
 };
 
 class EOINode : public Node {
 public:
-  EOINode() = default;
-  const NodeKind kind = NodeKind::EOI;
+  EOINode() : Node(NodeKind::EOI) {}
 
-  const std::string as_string() override {
-    return "Node(Kind: '" + node_kind_as_string(kind) + "')";
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::EOI;
   }
 };
 
 struct TypeNode : public Node {
-  const NodeKind kind = NodeKind::Type;
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::Type;
+  }
 
   enum class TypeKind { Simple, Array, Map };
   const TypeKind type_kind;
@@ -279,118 +293,96 @@ struct TypeNode : public Node {
   bool is_throwable = false;
   bool is_nullable = false;
 
-  std::string base_name;
+  // A view into the source, or a static string for implied types
+  std::string_view base_name;
   int array_size = -1;
-  std::shared_ptr<TypeNode> element_type;
-  std::shared_ptr<TypeNode> key_type;
-  std::shared_ptr<TypeNode> value_type;
-
-  TypeNode(std::string base_name_)
-      : type_kind(TypeKind::Simple), base_name(std::move(base_name_)) {}
-
-  TypeNode(int size, std::shared_ptr<TypeNode> elem_type)
-      : type_kind(TypeKind::Array), array_size(size),
-        element_type(std::move(elem_type)) {}
-
-  TypeNode(std::shared_ptr<TypeNode> key, std::shared_ptr<TypeNode> value)
-      : type_kind(TypeKind::Map), key_type(std::move(key)),
-        value_type(std::move(value)) {}
-
-  const std::string as_string() override {
-    std::string prefix;
-    if (is_const)
-      prefix += "const ";
-    if (is_comptime)
-      prefix += "comptime ";
-    if (is_reference)
-      prefix += "&";
-    if (is_throwable)
-      prefix += "!";
-
-    std::string core;
-    switch (type_kind) {
-    case TypeKind::Simple:
-      core = base_name;
-      break;
-    case TypeKind::Array:
-      core = "[";
-      if (array_size >= 0)
-        core += std::to_string(array_size);
-      core += "]";
-      core += element_type->as_string();
-      break;
-    case TypeKind::Map:
-      core = "{" + key_type->as_string() + "}" + value_type->as_string();
-      break;
-    }
-
-    std::string suffix = is_nullable ? "?" : "";
-    return "Node(Kind: '" + node_kind_as_string(kind) + "', Value: '" + prefix +
-           core + suffix + "')";
-  }
+  TypeNode *element_type = nullptr;
+  TypeNode *key_type = nullptr;
+  TypeNode *value_type = nullptr;
+
+  TypeNode(std::string_view base_name_)
+      : Node(NodeKind::Type), type_kind(TypeKind::Simple),
+        base_name(base_name_) {}
+
+  TypeNode(int size, TypeNode *elem_type)
+      : Node(NodeKind::Type), type_kind(TypeKind::Array), array_size(size),
+        element_type(elem_type) {}
+
+  TypeNode(TypeNode *key, TypeNode *value)
+      : Node(NodeKind::Type), type_kind(TypeKind::Map), key_type(key),
+        value_type(value) {}
 };
 
 class ImplicitReturnNode : public Node {
 public:
-  ImplicitReturnNode(NodeP value) : value(value) {};
+  ImplicitReturnNode(NodeP value)
+      : Node(NodeKind::ImplicitReturn), value(value) {};
 
-  const NodeKind kind = NodeKind::ImplicitReturn;
-  NodeP value;
-
-  const std::string as_string() override {
-    return "Node(Kind: '" + node_kind_as_string(kind) +
-           "', Value: " + value->as_string() + ")";
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::ImplicitReturn;
   }
+
+  NodeP value;
 };
 
 class NewExprNode : public Node {
 public:
-  NewExprNode(NodeP type, std::vector<NodeP> args) : type(type), args(args) {}
+  NewExprNode(NodeP type, ArenaSpan<NodeP> args)
+      : Node(NodeKind::NewExpr), type(type), args(args) {}
 
-  const NodeKind kind = NodeKind::NewExpr;
-  NodeP type;
-  std::vector<NodeP> args;
-
-  const std::string as_string() override {
-    std::string joined_args;
-    for (const auto &arg : args)
-      joined_args += "  " + arg->as_string() + ",\n";
-
-    return "Node(Kind '" + node_kind_as_string(kind) +
-           "', Type: " + type->as_string() + ", Args: [" + joined_args + "])";
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::NewExpr;
   }
+
+  NodeP type;
+  ArenaSpan<NodeP> args;
 };
 
 class ThrowNode : public Node {
 public:
-  ThrowNode(NodeP operand) : operand(operand) {};
-
-  const NodeKind kind = NodeKind::Throw;
-  NodeP operand;
+  ThrowNode(NodeP operand) : Node(NodeKind::Throw), operand(operand) {};
 
-  const std::string as_string() override {
-    return "Node(Kind: '" + node_kind_as_string(kind) +
-           "', Throwed: " + operand->as_string() + ")";
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::Throw;
   }
+
+  NodeP operand;
 };
 
 class UnlessExprNode : public Node {
 public:
-  UnlessExprNode(NodeP lhs, NodeP rhs) : lhs(lhs), rhs(rhs), has_ifso(false) {}
+  UnlessExprNode(NodeP lhs, NodeP rhs)
+      : Node(NodeKind::UnlessExpr), lhs(lhs), rhs(rhs), has_ifso(false) {}
 
   UnlessExprNode(NodeP lhs, NodeP rhs, NodeP ifso)
-      : lhs(lhs), rhs(rhs), has_ifso(true), ifso(ifso) {}
+      : Node(NodeKind::UnlessExpr), lhs(lhs), rhs(rhs), has_ifso(true),
+        ifso(ifso) {}
+
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::UnlessExpr;
+  }
 
-  const NodeKind kind = NodeKind::UnlessExpr;
   NodeP lhs;
   NodeP rhs;
 
   bool has_ifso;
-  NodeP ifso;
+  NodeP ifso = nullptr;
 };
 
-template <typename NodeType> inline NodeP to_nodep(NodeType node) {
-  return std::make_shared<NodeType>(node);
+// Stands in for a statement that failed to parse in recovery mode
+class ErrorNode : public Node {
+public:
+  ErrorNode(std::string_view message, long offset)
+      : Node(NodeKind::Error), message(message), offset(offset) {}
+
+  static bool classof(const Node *node) {
+    return node->kind == NodeKind::Error;
+  }
+
+  // Stored in the arena
+  std::string_view message;
+  // Byte offset of the error, -1 if unknown
+  long offset;
 };
 
 } // namespace parser
@@ -0,0 +1,124 @@
+#ifndef INCLUDE_PARSER_AST_ARENA_HPP_
+#define INCLUDE_PARSER_AST_ARENA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vanadium {
+namespace parser {
+
+// A fixed run of items stored in an AstArena. It does not own them.
+template <typename T> class ArenaSpan {
+public:
+  ArenaSpan() = default;
+  ArenaSpan(T *items, size_t count) : items(items), count(count) {}
+
+  T *begin() const { return items; }
+  T *end() const { return items + count; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  T &operator[](size_t i) const { return items[i]; }
+
+private:
+  T *items = nullptr;
+  size_t count = 0;
+};
+
+// Storage for the AST of one compilation unit. Allocating is a pointer bump
+// into chunks mapped straight from the OS, and the whole tree is freed at
+// once by unmapping them when the arena is destroyed. Destructors are not
+// run, so nodes may only hold trivially destructible members; the few
+// objects that need one are made with `make_owned()`. Not safe to use from
+// several threads.
+class AstArena {
+public:
+  AstArena() = default;
+  AstArena(AstArena &&) = delete;
+  AstArena(const AstArena &) = delete;
+  AstArena &operator=(AstArena &&) = delete;
+  AstArena &operator=(const AstArena &) = delete;
+  ~AstArena();
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "The arena never destroys what it makes, use make_owned()");
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Makes an object that is destroyed along with the arena
+  template <typename T, typename... Args> T *make_owned(Args &&...args) {
+    T *object = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    owned.push_back({[](void *p) { static_cast<T *>(p)->~T(); }, object});
+    return object;
+  }
+
+  template <typename T> ArenaSpan<T> copy(const T *items, size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "The arena never destroys what it stores");
+    if (count == 0) {
+      return ArenaSpan<T>();
+    }
+    T *stored = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    std::uninitialized_copy(items, items + count, stored);
+    return ArenaSpan<T>(stored, count);
+  }
+  template <typename T> ArenaSpan<T> copy(const std::vector<T> &items) {
+    return copy(items.data(), items.size());
+  }
+
+  std::string_view store(std::string_view text);
+
+  // Takes over everything `other` allocated, leaving it empty
+  void adopt(AstArena &other);
+
+  void *allocate(size_t size, size_t align) {
+    uintptr_t at = (reinterpret_cast<uintptr_t>(cursor) + align - 1) &
+                   ~static_cast<uintptr_t>(align - 1);
+    if (at + size > reinterpret_cast<uintptr_t>(limit)) {
+      return allocate_chunk(size, align);
+    }
+    cursor = reinterpret_cast<char *>(at + size);
+    return reinterpret_cast<void *>(at);
+  }
+
+  // Bytes handed out, and bytes mapped to hand them out from
+  size_t bytes_used() const;
+  size_t bytes_mapped() const;
+
+private:
+  // The first chunk's size, doubled for each chunk after it up to
+  // `max_chunk_size`
+  static constexpr size_t min_chunk_size = 64 * 1024;
+  static constexpr size_t max_chunk_size = 16 * 1024 * 1024;
+
+  struct Chunk {
+    char *base;
+    size_t size;
+  };
+  struct Owned {
+    void (*destroy)(void *);
+    void *object;
+  };
+
+  std::vector<Chunk> chunks;
+  std::vector<Owned> owned;
+  char *cursor = nullptr;
+  char *limit = nullptr;
+  // Bytes used in chunks before the current one
+  size_t used = 0;
+
+  void *allocate_chunk(size_t size, size_t align);
+};
+
+} // namespace parser
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_AST_ARENA_HPP_
@@ -0,0 +1,50 @@
+#ifndef INCLUDE_PARSER_AST_CACHE_HPP_
+#define INCLUDE_PARSER_AST_CACHE_HPP_
+
+#include "vanadium/parser/flat_ast.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace vanadium {
+namespace parser {
+
+// Flat ASTs of sources parsed before, one file per source in `dir` named by
+// a hash of its contents. An entry is the FlatAst encoding behind a small
+// header, and loading maps it read-only and uses it in place, so a hit
+// costs neither a parse nor an allocation per node.
+//
+// The cache is only ever an optimisation: entries that are missing, stale,
+// corrupt or from another version are misses, and failing to store one is
+// not an error. An entry is only read back by a compiler built from the
+// same lexer and parser sources, and only if its checksum still matches.
+class AstCache {
+public:
+  explicit AstCache(std::string dir) : dir(std::move(dir)) {}
+
+  // $VANADIUM_CACHE_DIR, else `vanadium/ast` under $XDG_CACHE_HOME or
+  // ~/.cache, or empty if there is no home to put it in
+  static std::string default_dir();
+
+  // The tree last stored for `source`, if any
+  std::optional<FlatAst> load(std::string_view source) const;
+  // Replaces the entry for `source` atomically, returning whether it could
+  bool store(std::string_view source, const FlatAst &ast) const;
+
+  const std::string &get_dir() const { return dir; }
+
+  // 64-bit hash of `text`, which names its entry
+  static uint64_t hash(std::string_view text);
+
+private:
+  std::string dir;
+
+  std::string path_for(uint64_t source_hash) const;
+};
+
+} // namespace parser
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_AST_CACHE_HPP_
@@ -0,0 +1,111 @@
+#ifndef INCLUDE_PARSER_AST_DUMPER_HPP_
+#define INCLUDE_PARSER_AST_DUMPER_HPP_
+
+#include "vanadium/parser/ast.hpp"
+#include "vanadium/parser/flat_ast.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vanadium {
+namespace parser {
+
+enum class DumpFormat {
+  // Node(Kind: 'BinaryExpr', Left: ..., Right: ..., Operator: '+'), that of
+  // Node::as_string()
+  Text,
+  // {"kind":"BinaryExpr","op":"+","lhs":{...},"rhs":{...}}
+  Json,
+  // (BinaryExpr :op "+" :lhs (...) :rhs (...))
+  SExpr,
+};
+
+struct DumpOptions {
+  DumpFormat format = DumpFormat::Text;
+  // Give every node its source offset as `pos`
+  bool positions = false;
+  // Nodes deeper than this are cut down to their kind, the roots being at
+  // depth 0
+  size_t max_depth = SIZE_MAX;
+};
+
+// Writes ASTs compactly, a node at a time, into a buffer it hands to the
+// stream or file descriptor whenever it fills up. No text is built per
+// node, and the nodes still to write are kept on a stack of its own, so
+// the time taken is linear in the size of the tree whatever its depth.
+//
+// In JSON and S-expressions every node has its `kind`. Its other fields
+// are named after the members of its node class, with text and scalars
+// before children, and flags left out unless set.
+class AstDumper {
+public:
+  explicit AstDumper(std::ostream &out, DumpOptions options = DumpOptions());
+  // Writes to `fd`, which it does not close
+  explicit AstDumper(int fd, DumpOptions options = DumpOptions());
+  AstDumper(const AstDumper &) = delete;
+  AstDumper &operator=(const AstDumper &) = delete;
+  // Flushes what is left, ignoring errors
+  ~AstDumper();
+
+  // Every root of `ast`, each on a line of its own
+  void dump(const FlatAst &ast);
+  // `node` and what it holds, with no newline
+  void dump(const FlatAst &ast, FlatAst::Index node);
+
+  // Throws std::runtime_error if the file descriptor cannot be written
+  void flush();
+
+private:
+  static constexpr size_t buffer_size = 64 * 1024;
+
+  struct Task {
+    enum Op : uint8_t { Node, Field, Text, String, Name, Modifiers } op;
+    // The node index, string id or modifier list
+    uint32_t value;
+    uint32_t depth;
+    // The field name or the text
+    std::string_view text;
+  };
+
+  std::ostream *stream = nullptr;
+  int fd = -1;
+  DumpOptions options;
+  std::string buffer;
+  // Kept between dumps to reuse their storage
+  std::vector<Task> work;
+  std::vector<Task> pending;
+
+  void put(std::string_view text) {
+    buffer.append(text.data(), text.size());
+    if (buffer.size() >= buffer_size) {
+      flush();
+    }
+  }
+  void put_number(uint64_t number);
+  void put_quoted(std::string_view text);
+  void put_field(std::string_view name);
+  void put_flag(std::string_view name, bool set);
+  void put_modifiers(IndexList modifiers);
+
+  // Writes the start of `node` and what it holds besides other nodes, and
+  // queues the rest
+  void open(const FlatAst &ast, FlatAst::Index node, uint32_t depth);
+  void open_text(const FlatAst &ast, FlatAst::Index node, uint32_t depth);
+  void queue_field(std::string_view name);
+  void queue_text(std::string_view text);
+  void queue_child(uint32_t node, uint32_t depth);
+  void queue_list(IndexList nodes, uint32_t depth);
+  void queue_string(Task::Op op, uint32_t id);
+};
+
+// Flattens the trees under `roots` and dumps them to `out`
+void dump(const std::vector<NodeP> &roots, std::ostream &out,
+          DumpOptions options = DumpOptions());
+
+} // namespace parser
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_AST_DUMPER_HPP_
@@ -0,0 +1,198 @@
+#ifndef INCLUDE_PARSER_AST_VISITOR_HPP_
+#define INCLUDE_PARSER_AST_VISITOR_HPP_
+
+#include "vanadium/parser/ast.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace vanadium {
+namespace parser {
+
+// Dispatches on a node's kind with a switch, so a pass costs no virtual call
+// or RTTI lookup per node. `Derived` defines the `visit_*()` it cares about
+// and the others fall back to `visit_node()`, which does nothing by default.
+//
+// A pass over whole trees calls `walk()` on each root and `visit_children()`
+// from its `visit_*()`. The children are then visited in source order once
+// that visit returns, depth first, with the nodes still to visit kept on a
+// stack of the visitor's own, so that no tree is too deep to walk.
+//
+//   struct Counter : ASTVisitor<Counter> {
+//     size_t count = 0;
+//     void visit_node(NodeP node) {
+//       count++;
+//       visit_children(node);
+//     }
+//   };
+//
+//   counter.walk(root);
+template <typename Derived, typename Result = void> class ASTVisitor {
+public:
+  Result visit(NodeP node) {
+    switch (node->kind) {
+    case NodeKind::Include:
+      return self().visit_include(cast<IncludeNode>(node));
+    case NodeKind::Block:
+      return self().visit_block(cast<BlockNode>(node));
+    case NodeKind::FuncDecl:
+      return self().visit_funcdecl(cast<FuncDeclNode>(node));
+    case NodeKind::VarDecl:
+      return self().visit_vardecl(cast<VarDeclNode>(node));
+    case NodeKind::BinaryExpr:
+      return self().visit_binary(cast<BinaryExprNode>(node));
+    case NodeKind::UnaryExpr:
+      return self().visit_unary(cast<UnaryExprNode>(node));
+    case NodeKind::Literal:
+      return self().visit_literal(cast<LiteralNode>(node));
+    case NodeKind::CallExpr:
+      return self().visit_call(cast<CallExprNode>(node));
+    case NodeKind::MemberAccess:
+      return self().visit_member(cast<MemberAccessNode>(node));
+    case NodeKind::EOI:
+      return self().visit_eoi(cast<EOINode>(node));
+    case NodeKind::Type:
+      return self().visit_type(cast<TypeNode>(node));
+    case NodeKind::ImplicitReturn:
+      return self().visit_implicit_return(cast<ImplicitReturnNode>(node));
+    case NodeKind::NewExpr:
+      return self().visit_new(cast<NewExprNode>(node));
+    case NodeKind::Throw:
+      return self().visit_throw(cast<ThrowNode>(node));
+    case NodeKind::UnlessExpr:
+      return self().visit_unless(cast<UnlessExprNode>(node));
+    case NodeKind::Error:
+      return self().visit_error(cast<ErrorNode>(node));
+    }
+    return self().visit_node(node);
+  }
+
+  Result visit_include(IncludeNode *node) { return self().visit_node(node); }
+  Result visit_block(BlockNode *node) { return self().visit_node(node); }
+  Result visit_funcdecl(FuncDeclNode *node) { return self().visit_node(node); }
+  Result visit_vardecl(VarDeclNode *node) { return self().visit_node(node); }
+  Result visit_binary(BinaryExprNode *node) { return self().visit_node(node); }
+  Result visit_unary(UnaryExprNode *node) { return self().visit_node(node); }
+  Result visit_literal(LiteralNode *node) { return self().visit_node(node); }
+  Result visit_call(CallExprNode *node) { return self().visit_node(node); }
+  Result visit_member(MemberAccessNode *node) {
+    return self().visit_node(node);
+  }
+  Result visit_eoi(EOINode *node) { return self().visit_node(node); }
+  Result visit_type(TypeNode *node) { return self().visit_node(node); }
+  Result visit_implicit_return(ImplicitReturnNode *node) {
+    return self().visit_node(node);
+  }
+  Result visit_new(NewExprNode *node) { return self().visit_node(node); }
+  Result visit_throw(ThrowNode *node) { return self().visit_node(node); }
+  Result visit_unless(UnlessExprNode *node) { return self().visit_node(node); }
+  Result visit_error(ErrorNode *node) { return self().visit_node(node); }
+
+  Result visit_node(NodeP) { return Result(); }
+
+  // Visits `node` and every node queued by visit_children() from then on
+  void walk(NodeP node) {
+    size_t base = queued.size();
+    try {
+      self().visit(node);
+      while (queued.size() > base) {
+        NodeP next = queued.back();
+        queued.pop_back();
+        self().visit(next);
+      }
+    } catch (...) {
+      queued.resize(base);
+      throw;
+    }
+  }
+
+  // Queues what `node` holds to be visited by walk(), in source order and
+  // before anything queued earlier. None of it has been visited yet when
+  // this returns. A function's body is parsed first if it was deferred.
+  void visit_children(NodeP node) {
+    size_t first = queued.size();
+    switch (node->kind) {
+    case NodeKind::Block:
+      queue_all(cast<BlockNode>(node)->inner);
+      break;
+    case NodeKind::FuncDecl: {
+      auto func = cast<FuncDeclNode>(node);
+      for (const auto &param : func->parameters) {
+        queue_child(param.second);
+      }
+      queue_child(func->ret_type);
+      queue_child(func->get_block());
+      break;
+    }
+    case NodeKind::VarDecl:
+      queue_child(cast<VarDeclNode>(node)->value);
+      break;
+    case NodeKind::BinaryExpr:
+      queue_child(cast<BinaryExprNode>(node)->lhs);
+      queue_child(cast<BinaryExprNode>(node)->rhs);
+      break;
+    case NodeKind::UnaryExpr:
+      queue_child(cast<UnaryExprNode>(node)->operand);
+      break;
+    case NodeKind::CallExpr:
+      queue_child(cast<CallExprNode>(node)->callee);
+      queue_all(cast<CallExprNode>(node)->args);
+      break;
+    case NodeKind::MemberAccess:
+      queue_child(cast<MemberAccessNode>(node)->object);
+      break;
+    case NodeKind::Type: {
+      auto type = cast<TypeNode>(node);
+      queue_child(type->element_type);
+      queue_child(type->key_type);
+      queue_child(type->value_type);
+      break;
+    }
+    case NodeKind::ImplicitReturn:
+      queue_child(cast<ImplicitReturnNode>(node)->value);
+      break;
+    case NodeKind::NewExpr:
+      queue_child(cast<NewExprNode>(node)->type);
+      queue_all(cast<NewExprNode>(node)->args);
+      break;
+    case NodeKind::Throw:
+      queue_child(cast<ThrowNode>(node)->operand);
+      break;
+    case NodeKind::UnlessExpr:
+      queue_child(cast<UnlessExprNode>(node)->lhs);
+      queue_child(cast<UnlessExprNode>(node)->rhs);
+      queue_child(cast<UnlessExprNode>(node)->ifso);
+      break;
+    case NodeKind::Include:
+    case NodeKind::Literal:
+    case NodeKind::EOI:
+    case NodeKind::Error:
+      break;
+    }
+    // The first child ends up on top
+    std::reverse(queued.begin() + first, queued.end());
+  }
+
+protected:
+  Derived &self() { return *static_cast<Derived *>(this); }
+
+private:
+  // Nodes left to visit, the next one last
+  std::vector<NodeP> queued;
+
+  void queue_child(NodeP child) {
+    if (child) {
+      queued.push_back(child);
+    }
+  }
+  void queue_all(ArenaSpan<NodeP> children) {
+    for (NodeP child : children) {
+      queue_child(child);
+    }
+  }
+};
+
+} // namespace parser
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_AST_VISITOR_HPP_
@@ -0,0 +1,65 @@
+#ifndef INCLUDE_PARSER_CHARCLASS_HPP_
+#define INCLUDE_PARSER_CHARCLASS_HPP_
+
+#include <array>
+#include <cstdint>
+
+namespace vanadium {
+namespace lexer {
+
+// Byte classes driving the lexer's dispatch. A byte can belong to several
+// classes ('!' and '?' both continue identifiers and are operators); the
+// lexer tests them in a fixed order.
+enum CharClass : uint8_t {
+  CC_IDENT_START = 1 << 0,
+  CC_IDENT_CONTINUE = 1 << 1,
+  CC_DIGIT = 1 << 2,
+  CC_OP = 1 << 3,
+  CC_PUNCT = 1 << 4,
+  CC_WHITESPACE = 1 << 5,
+  CC_QUOTE = 1 << 6,
+  CC_EOS = 1 << 7,
+};
+
+constexpr std::array<uint8_t, 256> make_char_classes() {
+  std::array<uint8_t, 256> table{};
+
+  for (int c = 'a'; c <= 'z'; c++) {
+    table[c] |= CC_IDENT_START | CC_IDENT_CONTINUE;
+    table[c - 'a' + 'A'] |= CC_IDENT_START | CC_IDENT_CONTINUE;
+  }
+  for (int c = '0'; c <= '9'; c++) {
+    table[c] |= CC_DIGIT | CC_IDENT_CONTINUE;
+  }
+  // `!` and `?` may end an identifier but not start one, so that `!x`,
+  // `!=` and `!int` lex as operators
+  table['_'] |= CC_IDENT_START | CC_IDENT_CONTINUE;
+  for (unsigned char c : {'!', '?'}) {
+    table[c] |= CC_IDENT_CONTINUE;
+  }
+  for (unsigned char c :
+       {'-', '+', '*', '/', '^', '=', '<', '>', '!', '?', '&', '|'}) {
+    table[c] |= CC_OP;
+  }
+  for (unsigned char c : {'(', ')', '{', '}', '[', ']', ':', '.', ','}) {
+    table[c] |= CC_PUNCT;
+  }
+  for (unsigned char c : {' ', '\t', '\n'}) {
+    table[c] |= CC_WHITESPACE;
+  }
+  table['"'] |= CC_QUOTE;
+  table[';'] |= CC_EOS;
+
+  return table;
+}
+
+constexpr std::array<uint8_t, 256> char_classes = make_char_classes();
+
+constexpr bool char_is(char c, uint8_t classes) {
+  return (char_classes[static_cast<unsigned char>(c)] & classes) != 0;
+}
+
+} // namespace lexer
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_CHARCLASS_HPP_
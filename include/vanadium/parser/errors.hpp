@@ -6,6 +6,7 @@
 #include <exception>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 namespace vanadium {
 namespace parser {
@@ -13,57 +14,83 @@ namespace parser {
 class ParseError : public std::exception {
 private:
   std::string message;
+  long offset;
 
 public:
-  ParseError(const std::string &msg) : message(msg) {}
+  ParseError(const std::string &msg) : message(msg), offset(-1) {}
+  ParseError(const std::string &msg, long offset)
+      : message(msg), offset(offset) {}
 
   const char *what() const throw() { return message.c_str(); }
+
+  /* Byte offset into the source the error refers to, if known */
+  bool has_offset() const { return offset >= 0; }
+  long get_offset() const { return offset; }
 };
 
 class UnexpectedChar : public ParseError {
 public:
   UnexpectedChar(char ch, int index, const std::string &notes = "")
       : ParseError("Unexpected char: '" GRN + std::string(1, ch) +
-                   CRESET "' at " MAG + std::to_string(index) + CRESET +
-                   (!notes.empty() ? (": " + notes) : "")) {}
+                       CRESET "' at " MAG + std::to_string(index) + CRESET +
+                       (!notes.empty() ? (": " + notes) : ""),
+                   index) {}
+  // A whole (possibly multi-byte) character
+  UnexpectedChar(std::string_view ch, int index, const std::string &notes = "")
+      : ParseError("Unexpected char: '" GRN + std::string(ch) +
+                       CRESET "' at " MAG + std::to_string(index) + CRESET +
+                       (!notes.empty() ? (": " + notes) : ""),
+                   index) {}
+};
+
+class InvalidEncoding : public ParseError {
+public:
+  InvalidEncoding(long offset)
+      : ParseError("Invalid UTF-8 at byte " MAG + std::to_string(offset) +
+                       CRESET,
+                   offset) {}
 };
 
 class UnexpectedToken : public ParseError {
 public:
-  UnexpectedToken(lexer::Token token, const std::string &notes = "")
-      : ParseError("Unexpected token: '" GRN + token.lexeme +
-                   CRESET "' at " MAG + token.pos.as_string() + CRESET +
-                   (!notes.empty() ? (": " + notes) : "")) {}
+  UnexpectedToken(const lexer::Token &token, const std::string &notes = "")
+      : ParseError("Unexpected token: '" GRN + std::string(token.lexeme) +
+                       CRESET "' at " MAG + token.pos.as_string() + CRESET +
+                       (!notes.empty() ? (": " + notes) : ""),
+                   token.pos.from) {}
 };
 
 class ExpectedToken : public ParseError {
 public:
-  ExpectedToken(const std::string &expected, lexer::Token got,
+  ExpectedToken(const std::string &expected, const lexer::Token &got,
                 const std::string &notes = "")
       : ParseError("Expected token '" GRN + expected +
-                   CRESET "' but got '" GRN + got.lexeme + CRESET "'" +
-                   (!notes.empty() ? (": " + notes) : "")) {}
+                       CRESET "' but got '" GRN + std::string(got.lexeme) +
+                       CRESET "'" + (!notes.empty() ? (": " + notes) : ""),
+                   got.pos.from) {}
 
-  ExpectedToken(lexer::TokenType expected, lexer::Token got,
+  ExpectedToken(lexer::TokenType expected, const lexer::Token &got,
                 const std::string &notes = "")
       : ParseError("Expected token " BLU + lexer::type_as_string(expected) +
-                   CRESET " but got '" GRN + got.lexeme + CRESET "'" +
-                   (!notes.empty() ? (": " + notes) : "")) {}
+                       CRESET " but got '" GRN + std::string(got.lexeme) +
+                       CRESET "'" + (!notes.empty() ? (": " + notes) : ""),
+                   got.pos.from) {}
 };
 
 class ExpectedOneOfTokens : public ParseError {
 public:
   ExpectedOneOfTokens(const std::vector<std::string> &expected,
-                      lexer::Token got, const std::string &notes = "")
-      : ParseError(construct_message(expected, got, notes)) {}
+                      const lexer::Token &got, const std::string &notes = "")
+      : ParseError(construct_message(expected, got, notes), got.pos.from) {}
 
   ExpectedOneOfTokens(const std::vector<lexer::TokenType> &expected,
-                      lexer::Token got, const std::string &notes = "")
-      : ParseError(construct_message(expected, got, notes)) {}
+                      const lexer::Token &got, const std::string &notes = "")
+      : ParseError(construct_message(expected, got, notes), got.pos.from) {}
 
 private:
   std::string construct_message(const std::vector<std::string> &expected,
-                                lexer::Token got, const std::string &notes) {
+                                const lexer::Token &got,
+                                const std::string &notes) {
     std::stringstream msg;
 
     if (expected.size() == 1) {
@@ -89,7 +116,7 @@ private:
 
   std::string
   construct_message(const std::vector<lexer::TokenType> &expected_types,
-                    lexer::Token got, const std::string &notes) {
+                    const lexer::Token &got, const std::string &notes) {
     std::stringstream msg;
     std::vector<std::string> expected;
     for (auto type : expected_types) {
@@ -112,12 +139,29 @@ public:
       : ParseError("Syntax error: " + details) {}
 };
 
+class NestingTooDeep : public ParseError {
+public:
+  NestingTooDeep(const lexer::Token &token, size_t max_depth)
+      : ParseError("Nesting deeper than " + std::to_string(max_depth) +
+                       " levels at " MAG + token.pos.as_string() + CRESET,
+                   token.pos.from) {}
+};
+
+// Raised in recovery mode once the error cap is reached
+class TooManyErrors : public ParseError {
+public:
+  TooManyErrors(size_t count)
+      : ParseError("Too many errors (" + std::to_string(count) +
+                   "), stopping") {}
+};
+
 class InvalidToken : public ParseError {
 public:
   InvalidToken(const lexer::Token &token, const std::string &reason = "")
-      : ParseError("Invalid token '" + token.lexeme + "' at " +
-                   token.pos.as_string() +
-                   (!reason.empty() ? (": " + reason) : "")) {}
+      : ParseError("Invalid token '" + std::string(token.lexeme) + "' at " +
+                       token.pos.as_string() +
+                       (!reason.empty() ? (": " + reason) : ""),
+                   token.pos.from) {}
 };
 
 } // namespace parser
@@ -0,0 +1,154 @@
+#ifndef INCLUDE_PARSER_FLAT_AST_HPP_
+#define INCLUDE_PARSER_FLAT_AST_HPP_
+
+#include "vanadium/parser/ast.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vanadium {
+namespace parser {
+
+// Node indices held by an extra_data list
+class IndexList {
+public:
+  IndexList() = default;
+  IndexList(const uint32_t *items, uint32_t count)
+      : items(items), count(count) {}
+
+  const uint32_t *begin() const { return items; }
+  const uint32_t *end() const { return items + count; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  uint32_t operator[](size_t i) const { return items[i]; }
+
+private:
+  const uint32_t *items = nullptr;
+  uint32_t count = 0;
+};
+
+// The AST as parallel arrays, in the manner of Zig's compiler: each node is
+// a 1-byte tag, 1 byte of flags, the source offset of its main token and two
+// 32-bit operands, 14 bytes in all. Children are node indices, always
+// greater than their parent's, and no node has two parents. Anything that
+// does not fit in two operands goes in `extra_data`, where a list is its
+// length followed by its items, and text goes in a table of strings.
+// Nothing points into memory, so the arrays are read straight from their
+// encoding, which can be written out and mapped back as it is.
+//
+// Operands by tag (`extra` is an extra_data index, `list` an extra_data
+// list, `str` a string id, `-` unused):
+//
+//   tag             flags          lhs          rhs
+//   Include         -              str from     list of str names
+//   Block           -              list inner   -
+//   FuncDecl        -              extra [1]    block
+//   VarDecl         const, static  value        extra [2]
+//   BinaryExpr      Operator       lhs          rhs
+//   UnaryExpr       Operator       operand      -
+//   Literal         TokenType      str value    extra [3] or -
+//   CallExpr        -              callee       list args
+//   MemberAccess    -              object       str member
+//   EOI             -              -            -
+//   Type            [4]            [5]          [5]
+//   ImplicitReturn  -              value        -
+//   NewExpr         -              type         list args
+//   Throw           -              operand      -
+//   UnlessExpr      has ifso       lhs          extra [rhs, ifso]
+//   Error           -              str message  offset
+//
+//   [1] name, ret_type, list modifiers, list (name, type) parameters, with
+//       the parameter list counting pairs
+//   [2] name, list modifiers
+//   [3] Int and Float: integer low, high, floating low, high, bits, and
+//       is_unsigned shifted left by 8
+//   [4] TypeKind, then is_const, is_comptime, is_reference, is_throwable and
+//       is_nullable as bits 2 to 6
+//   [5] Simple: str base_name, array size; Array: element_type, array size;
+//       Map: key_type, value_type. Array sizes of -1 are stored as `none`.
+class FlatAst {
+public:
+  typedef uint32_t Index;
+
+  // No node, string or offset
+  static constexpr uint32_t none = UINT32_MAX;
+
+  struct Data {
+    uint32_t lhs;
+    uint32_t rhs;
+  };
+
+  // An empty tree
+  FlatAst();
+
+  size_t size() const { return node_count; }
+  NodeKind tag(Index node) const { return tags[node]; }
+  uint8_t flags_of(Index node) const { return flags[node]; }
+  uint32_t pos(Index node) const { return positions[node]; }
+  Data data(Index node) const { return datas[node]; }
+
+  // The top-level items, the first list in extra_data
+  IndexList roots() const { return list(0); }
+  uint32_t extra(size_t at) const { return extra_data[at]; }
+  IndexList list(size_t at) const {
+    return IndexList(extra_data + at + 1, extra_data[at]);
+  }
+  std::string_view string(uint32_t id) const {
+    return std::string_view(string_bytes + string_starts[id],
+                            string_starts[id + 1] - string_starts[id]);
+  }
+
+  // Bytes of the encoding
+  size_t bytes() const { return encoded.size(); }
+
+  // The encoding the arrays are read from: a header, then the arrays in
+  // host byte order
+  std::string_view serialize() const { return encoded; }
+  // Reads a copy of `bytes`
+  static FlatAst deserialize(std::string_view bytes);
+  // Reads `bytes` where they are, kept alive by `owner`, unless they are
+  // misaligned and need copying first
+  static FlatAst map(std::string_view bytes, std::shared_ptr<const void> owner);
+  // Both throw std::runtime_error unless `bytes` came from serialize() and
+  // hold a tree: every index in range and every node but the roots the
+  // child of exactly one other
+
+  // The node and its subtree in the format of Node::as_string()
+  std::string as_string(Index node) const;
+
+private:
+  friend class Flattener;
+
+  std::shared_ptr<const void> owner;
+  std::string_view encoded;
+
+  uint32_t node_count = 0;
+  const NodeKind *tags = nullptr;
+  const uint8_t *flags = nullptr;
+  const uint32_t *positions = nullptr;
+  const Data *datas = nullptr;
+  uint32_t extra_count = 0;
+  const uint32_t *extra_data = nullptr;
+  // String `i` is bytes [string_starts[i], string_starts[i + 1])
+  uint32_t string_count = 0;
+  const uint32_t *string_starts = nullptr;
+  uint32_t string_byte_count = 0;
+  const char *string_bytes = nullptr;
+
+  // Points the arrays into `bytes`, whose header must have been checked and
+  // which must be 4-byte aligned
+  FlatAst(std::string_view bytes, std::shared_ptr<const void> owner);
+  static std::string_view empty_encoding();
+  void check() const;
+};
+
+// Encodes the trees under `roots`, parsing any deferred function bodies
+FlatAst flatten(const std::vector<NodeP> &roots);
+
+} // namespace parser
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_FLAT_AST_HPP_
@@ -0,0 +1,142 @@
+#ifndef INCLUDE_PARSER_KEYWORDS_HPP_
+#define INCLUDE_PARSER_KEYWORDS_HPP_
+
+#include "vanadium/parser/lexer.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace vanadium {
+namespace lexer {
+
+struct Keyword {
+  std::string_view text;
+  TokenType type;
+};
+
+constexpr Keyword keywords[] = {
+    {"if", TokenType::If},
+    {"else", TokenType::Else},
+    {"elif", TokenType::Elif},
+    {"while", TokenType::While},
+    {"for", TokenType::For},
+    {"in", TokenType::In},
+    {"repeat", TokenType::Repeat},
+    {"until", TokenType::Until},
+    {"defer", TokenType::Defer},
+    {"delete", TokenType::Delete},
+    {"match", TokenType::Match},
+    {"case", TokenType::Case},
+    {"default", TokenType::Default},
+    {"func", TokenType::Func},
+    {"return", TokenType::Return},
+    {"class", TokenType::Class},
+    {"public", TokenType::Public},
+    {"private", TokenType::Private},
+    {"override", TokenType::Override},
+    {"struct", TokenType::Struct},
+    {"iface", TokenType::Iface},
+    {"impl", TokenType::Impl},
+    {"enum", TokenType::Enum},
+    {"let", TokenType::Let},
+    {"const", TokenType::Const},
+    {"static", TokenType::Static},
+    {"export", TokenType::Export},
+    {"discard", TokenType::Discard},
+    {"from", TokenType::From},
+    {"include", TokenType::Include},
+    {"typeof", TokenType::Typeof},
+    {"throw", TokenType::Throw},
+    {"try", TokenType::Try},
+    {"catch", TokenType::Catch},
+    {"guard", TokenType::Guard},
+    {"as", TokenType::As},
+    {"unless", TokenType::Unless},
+    {"ifso", TokenType::Ifso},
+    {"ifnot", TokenType::Ifnot},
+    {"new", TokenType::New},
+    {"and", TokenType::And},
+    {"or", TokenType::Or},
+    {"not", TokenType::Not},
+    {"sealed", TokenType::Sealed},
+    {"comptime", TokenType::Comptime},
+    {"true", TokenType::Bool},
+    {"false", TokenType::Bool},
+    {"null", TokenType::Null}};
+
+constexpr size_t keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+
+/* Perfect hash */
+
+// Every keyword is told apart by its length and its first and last two
+// bytes, so only those are hashed. The seed is searched at compile time so
+// that no two keywords share a slot; a lookup is then one hash, one slot load
+// and at most one short compare.
+
+constexpr size_t keyword_min_length = 2;
+constexpr size_t keyword_max_length = 8;
+constexpr size_t keyword_slots = 256;
+
+constexpr uint32_t keyword_hash(std::string_view word, uint32_t seed) {
+  uint32_t h = seed ^ static_cast<uint32_t>(word.size());
+  for (char c : {word[0], word[1], word[word.size() - 2],
+                 word[word.size() - 1]}) {
+    h = (h ^ static_cast<unsigned char>(c)) * 0x01000193u;
+  }
+  return (h ^ (h >> 16)) % keyword_slots;
+}
+
+constexpr bool keyword_seed_is_perfect(uint32_t seed) {
+  bool used[keyword_slots] = {};
+  for (const auto &keyword : keywords) {
+    uint32_t slot = keyword_hash(keyword.text, seed);
+    if (used[slot]) {
+      return false;
+    }
+    used[slot] = true;
+  }
+  return true;
+}
+
+constexpr uint32_t find_keyword_seed() {
+  for (uint32_t seed = 0; seed < 100000; seed++) {
+    if (keyword_seed_is_perfect(seed)) {
+      return seed;
+    }
+  }
+  return UINT32_MAX;
+}
+
+constexpr uint32_t keyword_seed = find_keyword_seed();
+static_assert(keyword_seed != UINT32_MAX, "No perfect keyword hash seed");
+
+// Slot -> index into `keywords` plus one, 0 for an empty slot
+constexpr std::array<uint8_t, keyword_slots> make_keyword_slots() {
+  std::array<uint8_t, keyword_slots> slots{};
+  for (size_t i = 0; i < keyword_count; i++) {
+    slots[keyword_hash(keywords[i].text, keyword_seed)] = i + 1;
+  }
+  return slots;
+}
+
+constexpr std::array<uint8_t, keyword_slots> keyword_table =
+    make_keyword_slots();
+
+// Writes the keyword's token type to `type` if `word` is a keyword
+constexpr bool lookup_keyword(std::string_view word, TokenType &type) {
+  if (word.size() < keyword_min_length || word.size() > keyword_max_length) {
+    return false;
+  }
+  uint8_t entry = keyword_table[keyword_hash(word, keyword_seed)];
+  if (entry == 0 || keywords[entry - 1].text != word) {
+    return false;
+  }
+  type = keywords[entry - 1].type;
+  return true;
+}
+
+} // namespace lexer
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_KEYWORDS_HPP_
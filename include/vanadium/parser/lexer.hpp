@@ -1,16 +1,22 @@
 #ifndef INCLUDE_PARSER_LEXER_HPP_
 #define INCLUDE_PARSER_LEXER_HPP_
 
+#include "vanadium/parser/string_arena.hpp"
+#include "vanadium/source/source_manager.hpp"
+#include "vanadium/symbol.hpp"
+#include <cstdint>
 #include <iostream>
-#include <map>
-#include <set>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace vanadium {
 namespace lexer {
 
-enum class TokenType {
+enum class TokenType : uint8_t {
   // End of input
   EOI,
 
@@ -78,60 +84,6 @@ enum class TokenType {
 
 extern std::string type_as_string(TokenType type);
 
-const std::map<std::string, TokenType> keyword_map = {
-    {"if", TokenType::If},
-    {"else", TokenType::Else},
-    {"elif", TokenType::Elif},
-    {"while", TokenType::While},
-    {"for", TokenType::For},
-    {"in", TokenType::In},
-    {"repeat", TokenType::Repeat},
-    {"until", TokenType::Until},
-    {"defer", TokenType::Defer},
-    {"delete", TokenType::Delete},
-    {"match", TokenType::Match},
-    {"case", TokenType::Case},
-    {"default", TokenType::Default},
-    {"func", TokenType::Func},
-    {"return", TokenType::Return},
-    {"class", TokenType::Class},
-    {"public", TokenType::Public},
-    {"private", TokenType::Private},
-    {"override", TokenType::Override},
-    {"struct", TokenType::Struct},
-    {"iface", TokenType::Iface},
-    {"impl", TokenType::Impl},
-    {"enum", TokenType::Enum},
-    {"let", TokenType::Let},
-    {"const", TokenType::Const},
-    {"static", TokenType::Static},
-    {"export", TokenType::Export},
-    {"discard", TokenType::Discard},
-    {"from", TokenType::From},
-    {"include", TokenType::Include},
-    {"typeof", TokenType::Typeof},
-    {"throw", TokenType::Throw},
-    {"try", TokenType::Try},
-    {"catch", TokenType::Catch},
-    {"guard", TokenType::Guard},
-    {"as", TokenType::As},
-    {"unless", TokenType::Unless},
-    {"ifso", TokenType::Ifso},
-    {"ifnot", TokenType::Ifnot},
-    {"new", TokenType::New},
-    {"and", TokenType::And},
-    {"or", TokenType::Or},
-    {"not", TokenType::Not},
-    {"sealed", TokenType::Sealed},
-    {"comptime", TokenType::Comptime},
-    {"true", TokenType::Bool},
-    {"false", TokenType::Bool},
-    {"null", TokenType::Null}};
-
-const std::set<char> op_list = {'-', '+', '*', '/', '^', '=',
-                                '<', '>', '!', '?', '&', '|'};
-const std::set<char> punct_list = {'(', ')', '{', '}', '[', ']', ':', '.', ','};
-
 struct TokenPos {
   long from;
   long to;
@@ -146,18 +98,38 @@ struct TokenPos {
   }
 };
 
+// Value of an Int or Float token, decoded by the lexer. Integer literals are
+// unsigned: a minus sign in front of one is a separate operator. `bits` is
+// the width given by an `iN`, `uN` or `fN` suffix, and 0 without one.
+struct NumberValue {
+  uint64_t integer = 0;
+  double floating = 0;
+  uint8_t bits = 0;
+  bool is_unsigned = false;
+};
+
+// A token does not own its text: `lexeme` is a view into the source buffer
+// that was passed to `tokenize()`, which must outlive every token produced
+// from it. Identifiers also carry their interned `symbol`, numbers their
+// decoded `number`, and strings their contents with the escapes decoded in
+// `text`, which is the lexeme itself when there were none.
 struct Token {
   TokenType kind;
-  std::string lexeme;
+  std::string_view lexeme;
   TokenPos pos;
+  Symbol symbol;
+  NumberValue number;
+  std::string_view text;
 
-  Token(TokenType type, std::string lexeme)
+  Token() : kind(TokenType::EOI), pos(-1, -1) {}
+  Token(TokenType type, std::string_view lexeme)
       : kind(type), lexeme(lexeme), pos(-1, -1) {}
-  Token(TokenType type, std::string lexeme, TokenPos pos)
+  Token(TokenType type, std::string_view lexeme, TokenPos pos)
       : kind(type), lexeme(lexeme), pos(pos) {}
-  Token(TokenType type, std::string lexeme, int from, int to)
+  Token(TokenType type, std::string_view lexeme, int from, int to)
       : kind(type), lexeme(lexeme), pos(from, to) {}
-  Token(TokenType type, std::string lexeme, int from, int to, size_t line)
+  Token(TokenType type, std::string_view lexeme, int from, int to,
+        size_t line)
       : kind(type), lexeme(lexeme), pos(from, to, line) {}
 
   void display() const {
@@ -166,31 +138,223 @@ struct Token {
   };
 };
 
-typedef std::vector<Token> TokenList;
+// Token indices touched by `relex()`: `removed` tokens starting at `first`
+// were replaced by `inserted` new ones
+struct TokenEdit {
+  size_t first;
+  size_t removed;
+  size_t inserted;
+};
+
+// Tokens stored as parallel arrays of 1-byte kinds and 32-bit start offsets
+// into `source`, which must outlive the list. The rest of a token is derived
+// when it is read: its end by scanning it again, its line from a table of
+// line starts built on the first query. Decoded strings live in `strings`,
+// which a new list creates unless it is given one to share.
+class TokenList {
+public:
+  TokenList() = default;
+  explicit TokenList(std::string_view source,
+                     std::shared_ptr<StringArena> strings = nullptr);
+
+  void push_back(TokenType kind, size_t start);
+  void push_back(TokenType kind, size_t start, const NumberValue &number);
+  // A string whose decoded contents differ from its lexeme
+  void push_back(TokenType kind, size_t start, std::string_view text);
+  // Appends the tokens of `other` from index `first` on
+  void append(const TokenList &other, size_t first);
+  void reserve(size_t count);
+
+  size_t size() const { return kinds.size(); }
+  bool empty() const { return kinds.empty(); }
+  TokenType kind_of(size_t index) const { return kinds[index]; }
+  size_t start_of(size_t index) const { return starts[index]; }
+  size_t end_of(size_t index) const;
+  size_t line_of(size_t index) const;
+  // Decoded value of the Int or Float token at `index`
+  const NumberValue &number_of(size_t index) const;
+  // Decoded contents of the String token at `index`
+  std::string_view text_of(size_t index) const;
+  std::string_view get_source() const { return source; }
+  const std::shared_ptr<StringArena> &get_strings() const { return strings; }
+  // Index of the first token starting at or after `offset`
+  size_t lower_bound(size_t offset) const;
+
+  // Builds the full token at `index`, throwing std::out_of_range past the
+  // end of the list
+  Token at(size_t index) const;
+  Token operator[](size_t index) const { return at(index); }
+
+private:
+  std::string_view source;
+  std::vector<TokenType> kinds;
+  std::vector<uint32_t> starts;
+
+  // Values of the Int and Float tokens, by ascending token index
+  std::vector<uint32_t> number_tokens;
+  std::vector<NumberValue> numbers;
+
+  // Decoded contents of the String tokens that had escapes
+  std::shared_ptr<StringArena> strings;
+  std::vector<uint32_t> text_tokens;
+  std::vector<std::string_view> texts;
+
+  // Shared between copies and built by whichever reader needs it first
+  mutable std::shared_ptr<const std::vector<uint32_t>> line_starts;
+
+  const std::vector<uint32_t> &get_line_starts() const;
+
+  friend TokenEdit relex(TokenList &tokens, std::string &source,
+                         size_t offset, size_t removed,
+                         std::string_view replacement);
+};
+
+// Produces tokens one at a time. Once the input is exhausted every call
+// returns an EOI token. Strings with escapes are decoded into `strings`, a
+// new arena unless one is given.
+class Lexer {
+public:
+  Lexer(std::string_view input,
+        std::shared_ptr<StringArena> strings = nullptr);
+  // Resumes lexing `input` at byte `index`, counting lines from `line`
+  Lexer(std::string_view input, size_t index, size_t line,
+        std::shared_ptr<StringArena> strings = nullptr);
+  Lexer(Lexer &&) = default;
+  Lexer(const Lexer &) = default;
+  Lexer &operator=(Lexer &&) = default;
+  Lexer &operator=(const Lexer &) = default;
+  ~Lexer() = default;
 
+  Token next_token();
+  // Lexes the next token like `next_token()`, but only returns its kind and
+  // start offset
+  TokenType next_kind(size_t &from);
+  size_t get_index() const { return index; }
+  size_t get_line() const { return line; }
+  // Value of the last Int or Float token lexed
+  const NumberValue &get_number() const { return number; }
+  // Decoded contents of the last String token lexed, and whether they differ
+  // from its lexeme
+  std::string_view get_text() const { return text; }
+  bool text_has_escapes() const { return has_escapes; }
+  const std::shared_ptr<StringArena> &get_strings() const { return strings; }
+
+  // End offset of a token of `kind` that starts at `from`
+  static size_t token_end(std::string_view input, TokenType kind,
+                          size_t from);
+
+private:
+  std::string_view input;
+  size_t index;
+  size_t line;
+  NumberValue number;
+  std::string_view text;
+  bool has_escapes = false;
+  std::shared_ptr<StringArena> strings;
+
+  // Lexes the next token, returning its kind and storing where it starts
+  TokenType scan_token(size_t &from, size_t &from_line);
+};
+
+// Either walks a fully lexed TokenList, or pulls tokens from a Lexer on
+// demand. Both modes build the tokens they hand out into a ring buffer of the
+// last `lookahead` ones: a token reference stays valid until the stream has
+// moved `lookahead` tokens past it, and `peek()` reaches at most
+// `lookahead - 1` tokens ahead. In the streaming mode `get_tokens()` is empty.
+// The list is shared between copies of a stream and the streams made over a
+// range of it.
 class TokenStream {
 public:
-  TokenStream(TokenList input_tokens) : tokens(input_tokens), current(0) {};
+  static constexpr size_t lookahead = 16;
+
+  TokenStream(TokenList input_tokens)
+      : TokenStream(std::move(input_tokens), source::FileID()) {};
+  TokenStream(TokenList input_tokens, source::FileID file)
+      : tokens(std::make_shared<const TokenList>(std::move(input_tokens))),
+        current(0), file(file), ring(lookahead),
+        ring_index(lookahead, SIZE_MAX) {
+    last = tokens->empty() ? 0 : tokens->size() - 1;
+  };
+  // Walks tokens [first, last) of `tokens`, then reads as the end of input
+  TokenStream(std::shared_ptr<const TokenList> tokens, size_t first,
+              size_t last, source::FileID file = source::FileID())
+      : tokens(std::move(tokens)), current(first), file(file),
+        ring(lookahead), ring_index(lookahead, SIZE_MAX), last(last) {};
+  TokenStream(Lexer lexer, source::FileID file = source::FileID())
+      : tokens(std::make_shared<const TokenList>()), current(0), file(file),
+        ring(lookahead), lexer(std::move(lexer)) {};
   TokenStream(TokenStream &&) = default;
   TokenStream(const TokenStream &) = default;
   TokenStream &operator=(TokenStream &&) = default;
   TokenStream &operator=(const TokenStream &) = default;
   ~TokenStream() = default;
 
-  Token next();
-  Token get();
+  const Token &next();
+  const Token &get();
   bool has_next();
   bool next_is_eoi();
-  Token peek(size_t offset);
+  const Token &peek(size_t offset = 1);
   const size_t get_index();
-  const TokenList get_tokens();
+  const TokenList &get_tokens();
+  const std::shared_ptr<const TokenList> &share_tokens() const {
+    return tokens;
+  }
+
+  // Position to come back to with `rewind()`. A streaming stream can only
+  // go back as far as its lookahead buffer reaches.
+  size_t checkpoint() const { return current; }
+  void rewind(size_t checkpoint);
+  // Moves ahead to `index` without building the tokens in between. List
+  // mode only.
+  void skip_to(size_t index);
+
+  source::FileID get_file() const { return file; }
+  bool is_streaming() const { return lexer.has_value(); }
+  const std::shared_ptr<StringArena> &get_strings() const;
 
 private:
-  TokenList tokens;
+  std::shared_ptr<const TokenList> tokens;
   size_t current;
+  source::FileID file;
+  std::vector<Token> ring;
+
+  /* List mode: the token index each ring slot holds, and the index read as
+     the end of input */
+  std::vector<size_t> ring_index;
+  size_t last = 0;
+
+  /* Streaming mode */
+  std::optional<Lexer> lexer;
+  size_t pulled = 0;
+
+  const Token &at(size_t index);
 };
 
-extern TokenStream tokenize(std::string input);
+extern TokenStream tokenize(std::string_view input);
+extern TokenStream tokenize(const source::SourceManager &sources,
+                            source::FileID file);
+
+// Splits the input at newlines and lexes the pieces on `jobs` threads (the
+// hardware concurrency when 0). The result is identical to `tokenize()`.
+// `tokenize()` switches to this on its own for inputs of at least
+// `parallel_lex_threshold` bytes.
+constexpr size_t parallel_lex_threshold = 16 * 1024 * 1024;
+extern TokenStream tokenize_parallel(std::string_view input,
+                                     unsigned jobs = 0);
+
+// Streaming counterparts of `tokenize()`: nothing is lexed until the stream
+// is read from
+extern TokenStream stream_tokens(std::string_view input);
+extern TokenStream stream_tokens(const source::SourceManager &sources,
+                                 source::FileID file);
+
+// Replaces `removed` bytes of `source` at `offset` with `replacement` and
+// updates `tokens`, which were lexed from `source` before the edit. Only the
+// stretch from the last token ending before the edit up to the point where
+// the new tokens line up with the old ones again is re-lexed; the tokens
+// after it are shifted in place.
+extern TokenEdit relex(TokenList &tokens, std::string &source, size_t offset,
+                       size_t removed, std::string_view replacement);
 
 } // namespace lexer
 } // namespace vanadium
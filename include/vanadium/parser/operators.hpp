@@ -0,0 +1,165 @@
+#ifndef INCLUDE_PARSER_OPERATORS_HPP_
+#define INCLUDE_PARSER_OPERATORS_HPP_
+
+#include "vanadium/parser/lexer.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace vanadium {
+namespace parser {
+
+// Every token the Pratt parser can treat as an operator. Symbolic ones come
+// from Op tokens, `.` and `(` from Punct and the rest from keywords.
+enum class Operator : uint8_t {
+  None,
+
+  // Symbols
+  Plus,
+  Minus,
+  Star,
+  Slash,
+  Caret,
+  Amp,
+  Pipe,
+  Bang,
+  Less,
+  Greater,
+  Assign,
+  Equal,
+  NotEqual,
+  LessEqual,
+  GreaterEqual,
+  PlusAssign,
+  MinusAssign,
+  StarAssign,
+  SlashAssign,
+  CaretAssign,
+  AmpAssign,
+  PipeAssign,
+  AmpAmp,
+  PipePipe,
+  ShiftLeft,
+  ShiftRight,
+
+  // Punctuation
+  Dot,
+  LParen,
+
+  // Keywords
+  And,
+  Or,
+  Not,
+  Unless,
+  Typeof,
+  Discard,
+  Delete,
+  Defer,
+
+  Count
+};
+
+constexpr size_t operator_count = static_cast<size_t>(Operator::Count);
+
+// How each operator is written, as stored in the AST
+constexpr std::array<std::string_view, operator_count> operator_spellings = {
+    "",
+    // Symbols
+    "+", "-", "*", "/", "^", "&", "|", "!", "<", ">", "=", "==", "!=", "<=",
+    ">=", "+=", "-=", "*=", "/=", "^=", "&=", "|=", "&&", "||", "<<", ">>",
+    // Punctuation
+    ".", "(",
+    // Keywords
+    "and", "or", "not", "unless", "typeof", "discard", "delete", "defer"};
+static_assert(operator_spellings[operator_count - 1] == "defer",
+              "Every operator needs a spelling");
+
+constexpr std::string_view spelling_of(Operator op) {
+  return operator_spellings[static_cast<size_t>(op)];
+}
+
+// The operator spelled `spelling`, as in the AST, or None
+constexpr Operator operator_spelled(std::string_view spelling) {
+  for (size_t i = 1; i < operator_count; i++) {
+    if (operator_spellings[i] == spelling) {
+      return static_cast<Operator>(i);
+    }
+  }
+  return Operator::None;
+}
+
+// Op tokens are one or two bytes long (see the lexer), so they are told
+// apart by a switch on their bytes
+constexpr Operator symbol_operator(std::string_view lexeme) {
+  char second = lexeme.size() > 1 ? lexeme[1] : '\0';
+
+  switch (lexeme[0]) {
+  case '+':
+    return second == '=' ? Operator::PlusAssign : Operator::Plus;
+  case '-':
+    return second == '=' ? Operator::MinusAssign : Operator::Minus;
+  case '*':
+    return second == '=' ? Operator::StarAssign : Operator::Star;
+  case '/':
+    return second == '=' ? Operator::SlashAssign : Operator::Slash;
+  case '^':
+    return second == '=' ? Operator::CaretAssign : Operator::Caret;
+  case '&':
+    return second == '=' ? Operator::AmpAssign
+           : second == '&' ? Operator::AmpAmp
+                           : Operator::Amp;
+  case '|':
+    return second == '=' ? Operator::PipeAssign
+           : second == '|' ? Operator::PipePipe
+                           : Operator::Pipe;
+  case '!':
+    return second == '=' ? Operator::NotEqual : Operator::Bang;
+  case '<':
+    return second == '=' ? Operator::LessEqual
+           : second == '<' ? Operator::ShiftLeft
+                           : Operator::Less;
+  case '>':
+    return second == '=' ? Operator::GreaterEqual
+           : second == '>' ? Operator::ShiftRight
+                           : Operator::Greater;
+  case '=':
+    return second == '=' ? Operator::Equal : Operator::Assign;
+  default:
+    return Operator::None;
+  }
+}
+
+constexpr Operator operator_of(const lexer::Token &tk) {
+  switch (tk.kind) {
+  case lexer::TokenType::Op:
+    return symbol_operator(tk.lexeme);
+  case lexer::TokenType::Punct:
+    return tk.lexeme[0] == '.'   ? Operator::Dot
+           : tk.lexeme[0] == '(' ? Operator::LParen
+                                 : Operator::None;
+  case lexer::TokenType::And:
+    return Operator::And;
+  case lexer::TokenType::Or:
+    return Operator::Or;
+  case lexer::TokenType::Not:
+    return Operator::Not;
+  case lexer::TokenType::Unless:
+    return Operator::Unless;
+  case lexer::TokenType::Typeof:
+    return Operator::Typeof;
+  case lexer::TokenType::Discard:
+    return Operator::Discard;
+  case lexer::TokenType::Delete:
+    return Operator::Delete;
+  case lexer::TokenType::Defer:
+    return Operator::Defer;
+  default:
+    return Operator::None;
+  }
+}
+
+} // namespace parser
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_OPERATORS_HPP_
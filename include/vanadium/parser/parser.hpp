@@ -2,28 +2,82 @@
 #define INCLUDE_PARSER_PARSER_HPP_
 
 #include "vanadium/parser/ast.hpp"
+#include "vanadium/parser/errors.hpp"
 #include "vanadium/parser/lexer.hpp"
+#include "vanadium/parser/operators.hpp"
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <utility>
 #include <vector>
 
 namespace vanadium {
 namespace parser {
 
+// Binding powers, loosest first
 enum Precedence {
   PREC_LOWEST = 0,
-  PREC_ASSIGNMENT = 1,
-  PREC_TERM = 2,
-  PREC_FACTOR = 3,
-  PREC_PREFIX = 4,
-  PREC_CALL = 5,
+  PREC_ASSIGNMENT, // = += -= *= /= ^= &= |=
+  PREC_UNLESS,     // unless ... ifso
+  PREC_OR,         // or ||
+  PREC_AND,        // and &&
+  PREC_COMPARISON, // == != < > <= >=
+  PREC_BIT_OR,     // |
+  PREC_BIT_XOR,    // ^
+  PREC_BIT_AND,    // &
+  PREC_SHIFT,      // << >>
+  PREC_TERM,       // + -
+  PREC_FACTOR,     // * /
+  PREC_PREFIX,
+  PREC_CALL,
+};
+
+enum class Assoc : uint8_t { Left, Right };
+
+// What follows an operator the Pratt parser has consumed
+enum class OperatorForm : uint8_t {
+  None,
+  // An operand, at the operator's prefix binding power
+  Unary,
+  // An expression and `)`
+  Group,
+  // A right operand
+  Binary,
+  // A right operand, then maybe `ifso` and another
+  Unless,
+  // Arguments up to `)`
+  Call,
+  // A member name
+  Member,
+};
+
+// How the Pratt parser handles an operator. Postfix operators (calls,
+// member access) use the infix slot and read no right operand.
+struct OperatorRule {
+  // Binding power in prefix position, PREC_LOWEST if it cannot start an
+  // expression
+  Precedence prefix = PREC_LOWEST;
+  // Binding power after an operand, PREC_LOWEST if it cannot follow one
+  Precedence infix = PREC_LOWEST;
+  Assoc assoc = Assoc::Left;
+  OperatorForm prefix_form = OperatorForm::None;
+  OperatorForm infix_form = OperatorForm::None;
 };
 
 typedef std::vector<NodeP> NodeList;
 
+// Parsed nodes of a compilation unit. They live in `arena` and their text
+// refers to the source and to `strings`, both of which the stream keeps
+// alive; a node must not be used once every copy of the stream is gone.
 class NodeStream {
 public:
   NodeStream(NodeList input_nodes) : nodes(input_nodes), current(0) {};
+  NodeStream(NodeList input_nodes,
+             std::shared_ptr<const lexer::StringArena> strings,
+             std::shared_ptr<AstArena> arena)
+      : nodes(input_nodes), current(0), strings(std::move(strings)),
+        arena(std::move(arena)) {};
   NodeStream(NodeStream &&) = default;
   NodeStream(const NodeStream &) = default;
   NodeStream &operator=(NodeStream &&) = default;
@@ -35,15 +89,43 @@ public:
   bool has_next();
   const size_t get_index();
   const NodeList get_nodes();
+  const std::shared_ptr<AstArena> &get_arena() const { return arena; }
 
 private:
   NodeList nodes;
   size_t current;
+  std::shared_ptr<const lexer::StringArena> strings;
+  std::shared_ptr<AstArena> arena;
+};
+
+struct ParseOptions {
+  // Record syntax errors, put an ErrorNode in place of the statement and
+  // carry on from the next `;`, `}` or declaration instead of throwing
+  bool recover = false;
+  // In recovery mode, the parse stops after this many errors
+  size_t max_errors = 20;
+  // Threads parsing top-level items at once, the hardware concurrency when
+  // 0. Only fully lexed streams of at least `parallel_parse_threshold`
+  // tokens are split between threads.
+  unsigned jobs = 0;
+  // Skip function bodies by matching their braces and parse each one when
+  // its FuncDeclNode is first asked for it. Streaming streams always parse
+  // bodies right away.
+  bool lazy_bodies = false;
+  // Statements, expressions and types nested deeper than this are an error.
+  // Nesting takes no native stack, only a few dozen bytes of heap a level.
+  size_t max_depth = 1 << 18;
 };
 
+constexpr size_t parallel_parse_threshold = 64 * 1024;
+
 class Parser {
 public:
-  Parser(lexer::TokenStream ts) : ts(ts) {};
+  Parser(lexer::TokenStream ts)
+      : ts(std::move(ts)), arena(std::make_shared<AstArena>()) {};
+  Parser(lexer::TokenStream ts, ParseOptions options)
+      : ts(std::move(ts)), options(options),
+        arena(std::make_shared<AstArena>()) {};
   Parser(Parser &&) = default;
   Parser(const Parser &) = default;
   Parser &operator=(Parser &&) = default;
@@ -52,35 +134,147 @@ public:
 
   NodeStream parse();
 
+  // Errors recovered from, in source order
+  const std::vector<ParseError> &get_errors() const { return errors; }
+  // Whether parsing stopped early at `max_errors`
+  bool hit_error_limit() const { return gave_up; }
+
 private:
+  // Rules that nest are run as loops over stacks of frames, a frame being a
+  // rule waiting for a nested one to finish, rather than by recursion. The
+  // depth of the input then costs heap instead of native stack.
+
+  // A statement, block, declaration or `throw` waiting for a statement,
+  // block or expression
+  struct StatementFrame {
+    enum Step : uint8_t {
+      Statement,
+      Block,
+      ImplicitReturn,
+      Throw,
+      VarDecl,
+      FuncDecl
+    };
+    Step step = Statement;
+    bool is_const = false;
+    bool is_static = false;
+    uint32_t pos = 0;
+    // Statement: the token it starts at, where recovery resumes from.
+    // Block: the index of its first child in `pending`.
+    size_t mark = 0;
+    // Statement: the size of `pending` and the depth it started at
+    size_t pending_start = 0;
+    size_t depth = 0;
+    Symbol name;
+    ArenaSpan<lexer::TokenType> modifiers;
+    ArenaSpan<std::pair<Symbol, NodeP>> params;
+    NodeP ret_type = nullptr;
+  };
+
+  // An operator waiting for an operand
+  struct ExprFrame {
+    enum Step : uint8_t { Unary, Group, Binary, Unless, Ifso, Argument };
+    Step step = Unary;
+    Operator op = Operator::None;
+    // Of the loop to go back to once the operand is parsed
+    int precedence = PREC_LOWEST;
+    uint32_t pos = 0;
+    // The left operand, or the callee of an Argument
+    NodeP left = nullptr;
+    // The right operand of an Ifso
+    NodeP right = nullptr;
+    // Argument: the index of the first one in `pending`
+    size_t first = 0;
+  };
+
+  // An array or map type waiting for its element, key or value type
+  struct TypeFrame {
+    enum Step : uint8_t { Element, Key, Value };
+    Step step = Element;
+    bool is_const = false;
+    bool is_comptime = false;
+    bool is_reference = false;
+    bool is_throwable = false;
+    uint32_t pos = 0;
+    int size = -1;
+    TypeNode *key = nullptr;
+  };
+
+  enum class Start : uint8_t { Statement, Block, Expr };
+
   lexer::TokenStream ts;
+  ParseOptions options;
+  std::vector<ParseError> errors;
+  bool gave_up = false;
+  // Nesting level of the statements, expressions and types being parsed
+  size_t depth = 0;
+  // Where the nodes go
+  std::shared_ptr<AstArena> arena;
+  // Children of the lists being parsed, innermost last, until they are
+  // copied into the arena
+  std::vector<NodeP> pending;
+  // Innermost last, kept between rules to reuse their storage
+  std::vector<StatementFrame> statement_frames;
+  std::vector<ExprFrame> expr_frames;
+  std::vector<TypeFrame> type_frames;
+
+  // A node whose main token starts at `pos`
+  template <typename T, typename... Args>
+  T *make(uint32_t pos, Args &&...args) {
+    T *node = arena->make<T>(std::forward<Args>(args)...);
+    node->pos = pos;
+    return node;
+  }
+  uint32_t here() { return static_cast<uint32_t>(ts.get().pos.from); }
+  ArenaSpan<NodeP> take_pending(size_t from);
+  // Enters one more level of nesting, throwing NestingTooDeep past
+  // `max_depth`
+  void nest();
 
   /* Main */
-  NodeP parse_start();
+  NodeList parse_items();
+  bool parse_parallel(unsigned jobs, NodeList &nodes);
+  NodeP parse_statement();
+  NodeP parse_nested(Start start);
+  NodeP start_rule(Start &start);
+  NodeP resume_statement(NodeP node, Start &start);
+  NodeP recover(size_t statement, const ParseError &err);
+  NodeP parse_start(Start &start);
+  void synchronize();
 
   /* Expressions */
-  NodeP parse_expr();
+  NodeP parse_expr(Start &start);
   NodeP parse_block();
+  NodeP open_block(Start &start);
+  NodeP next_in_block(Start &start);
   NodeP parse_type();
+  TypeNode *start_type();
+  void finish_type(TypeNode *node, const TypeFrame &qualifiers);
   NodeP parse_new();
-  NodeP parse_throw();
+  NodeP open_throw(Start &start);
 
   /* Pratt */
+  static const std::array<OperatorRule, operator_count> operator_rules;
+  static const OperatorRule &rule_of(Operator op);
+
   NodeP pratt(int precedence);
-  NodeP parse_prefix();
-  NodeP parse_infix(NodeP left, Precedence precedence);
+  NodeP parse_prefix(int &precedence);
+  bool parse_infix(NodeP &left, int &precedence);
+  NodeP resume_expr(NodeP operand, int &precedence);
+  ArenaSpan<NodeP> parse_arguments();
 
   /* Declarations */
   NodeP parse_decl();
-  NodeP parse_vardecl(std::vector<lexer::TokenType> modfs);
-  NodeP parse_funcdecl(std::vector<lexer::TokenType> modfs);
+  NodeP open_vardecl(std::vector<lexer::TokenType> modfs, Start &start);
+  NodeP open_funcdecl(std::vector<lexer::TokenType> modfs, Start &start);
+  DeferredNode *defer_block();
   NodeP parse_classdecl();
   NodeP parse_structdecl();
 
   /* Misc. */
   NodeP parse_include();
   std::vector<lexer::TokenType> parse_modifiers();
-  std::vector<std::pair<std::string, NodeP>> parse_parameters();
+  std::vector<std::pair<Symbol, NodeP>> parse_parameters();
 };
 
 } // namespace parser
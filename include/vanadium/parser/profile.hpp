@@ -0,0 +1,72 @@
+#ifndef INCLUDE_PARSER_PROFILE_HPP_
+#define INCLUDE_PARSER_PROFILE_HPP_
+
+#include "vanadium/parser/lexer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace vanadium {
+namespace parser {
+namespace profile {
+
+// Per-rule parser statistics. The grammar rules are only instrumented when
+// built with VANADIUM_PARSER_PROFILE, and even then nothing is collected
+// until `set_enabled(true)`.
+
+// Whether this build instruments the grammar rules
+bool is_available();
+
+void set_enabled(bool enabled);
+bool is_enabled();
+
+// Statistics of one grammar rule. Rules register themselves on construction
+// and are meant to be function-local statics.
+struct Rule {
+  explicit Rule(const char *name);
+  Rule(const Rule &) = delete;
+  Rule &operator=(const Rule &) = delete;
+
+  const char *name;
+  std::atomic<uint64_t> calls{0};
+  // Tokens consumed and time spent, including nested rules
+  std::atomic<uint64_t> tokens{0};
+  std::atomic<uint64_t> total_ns{0};
+  // Time spent excluding nested rules
+  std::atomic<uint64_t> self_ns{0};
+
+  Rule *next = nullptr;
+};
+
+// Accounts one call of `rule` from construction to destruction
+class Scope {
+public:
+  Scope(Rule &rule, lexer::TokenStream &ts);
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+  ~Scope();
+
+private:
+  // Null when collection was disabled at construction
+  Rule *rule;
+  lexer::TokenStream &ts;
+  size_t first_token = 0;
+  std::chrono::steady_clock::time_point start;
+  uint64_t nested_ns = 0;
+  Scope *parent = nullptr;
+};
+
+// Zeroes the statistics of every rule
+void reset();
+
+// Writes a table of the rules that were called, hottest (by self time)
+// first
+void dump(std::ostream &os);
+
+} // namespace profile
+} // namespace parser
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_PROFILE_HPP_
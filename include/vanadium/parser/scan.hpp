@@ -0,0 +1,54 @@
+#ifndef INCLUDE_PARSER_SCAN_HPP_
+#define INCLUDE_PARSER_SCAN_HPP_
+
+#include <cstddef>
+
+namespace vanadium {
+namespace lexer {
+namespace scan {
+
+// Byte-scanning kernels behind the lexer's hot loops. Every kernel has a
+// scalar, an SSE2 and an AVX2 implementation; the widest one the CPU supports
+// is picked on first use. All kernels stay within [p, end) and return `end`
+// when the scan runs off the input.
+
+enum class Isa { Scalar, SSE2, AVX2 };
+
+// Best instruction set supported by the running CPU
+Isa detected_isa();
+// Instruction set the kernels currently dispatch to
+Isa active_isa();
+// Forces the kernels down to `isa` (clamped to what the CPU supports), so
+// the vector paths can be checked against the scalar one
+void set_isa(Isa isa);
+const char *isa_name(Isa isa);
+
+// First byte that is not ' ', '\t' or '\n'. Adds the skipped newlines to
+// `lines`.
+const char *skip_whitespace(const char *p, const char *end, size_t &lines);
+
+// First '\n'
+const char *find_line_end(const char *p, const char *end);
+
+// The '*' of the first "*@" that fits in the input. Adds the newlines before
+// it (or before `end`) to `lines`.
+const char *find_block_comment_end(const char *p, const char *end,
+                                   size_t &lines);
+
+// First byte that cannot continue an identifier ([A-Za-z0-9_!?])
+const char *skip_ident(const char *p, const char *end);
+
+// First byte that is not a decimal digit
+const char *skip_digits(const char *p, const char *end);
+
+// First '"' or '\\'
+const char *find_quote_or_escape(const char *p, const char *end);
+
+// First byte that does not start a well-formed UTF-8 sequence, or `end`
+const char *validate_utf8(const char *p, const char *end);
+
+} // namespace scan
+} // namespace lexer
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_SCAN_HPP_
@@ -0,0 +1,46 @@
+#ifndef INCLUDE_PARSER_STRING_ARENA_HPP_
+#define INCLUDE_PARSER_STRING_ARENA_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace vanadium {
+namespace lexer {
+
+// Storage for the decoded contents of string literals that had escapes,
+// shared by one compilation. Equal contents are stored once, and a stored
+// string stays put until the arena is destroyed. Safe to use from several
+// threads.
+class StringArena {
+public:
+  StringArena() = default;
+  StringArena(StringArena &&) = delete;
+  StringArena(const StringArena &) = delete;
+  StringArena &operator=(StringArena &&) = delete;
+  StringArena &operator=(const StringArena &) = delete;
+  ~StringArena() = default;
+
+  std::string_view store(std::string_view text);
+
+  size_t string_count() const;
+  size_t bytes_used() const;
+
+private:
+  static constexpr size_t chunk_size = 64 * 1024;
+
+  mutable std::mutex lock;
+  std::unordered_set<std::string_view> strings;
+  std::vector<std::unique_ptr<char[]>> chunks;
+  char *cursor = nullptr;
+  size_t left = 0;
+  size_t used = 0;
+};
+
+} // namespace lexer
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_STRING_ARENA_HPP_
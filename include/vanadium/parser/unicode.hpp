@@ -0,0 +1,65 @@
+#ifndef INCLUDE_PARSER_UNICODE_HPP_
+#define INCLUDE_PARSER_UNICODE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vanadium {
+namespace lexer {
+
+// Identifier classes of non-ASCII code points, from the tables generated by
+// tools/gen_unicode_tables.py. ASCII is left to the byte class table.
+bool is_xid_start(uint32_t code);
+bool is_xid_continue(uint32_t code);
+
+// Decodes the UTF-8 sequence at `p` into `code` and returns its length, or 0
+// if the sequence is truncated, overlong, a surrogate or past U+10FFFF
+inline size_t decode_utf8(const char *p, const char *end, uint32_t &code) {
+  const unsigned char *s = reinterpret_cast<const unsigned char *>(p);
+  size_t left = end - p;
+  if (left == 0) {
+    return 0;
+  }
+
+  unsigned char lead = s[0];
+  size_t length;
+  uint32_t min;
+  if (lead < 0x80) {
+    code = lead;
+    return 1;
+  } else if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2;
+    min = 0x80;
+    code = lead & 0x1F;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3;
+    min = 0x800;
+    code = lead & 0x0F;
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4;
+    min = 0x10000;
+    code = lead & 0x07;
+  } else {
+    return 0;
+  }
+
+  if (left < length) {
+    return 0;
+  }
+  for (size_t i = 1; i < length; i++) {
+    if ((s[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+    code = (code << 6) | (s[i] & 0x3F);
+  }
+
+  if (code < min || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) {
+    return 0;
+  }
+  return length;
+}
+
+} // namespace lexer
+} // namespace vanadium
+
+#endif // INCLUDE_PARSER_UNICODE_HPP_
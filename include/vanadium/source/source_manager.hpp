@@ -0,0 +1,113 @@
+#ifndef INCLUDE_SOURCE_SOURCE_MANAGER_HPP_
+#define INCLUDE_SOURCE_SOURCE_MANAGER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace vanadium {
+namespace source {
+
+struct FileID {
+  uint32_t id;
+
+  FileID() : id(UINT32_MAX) {};
+  explicit FileID(uint32_t id) : id(id) {};
+
+  bool is_valid() const { return id != UINT32_MAX; }
+  bool operator==(FileID other) const { return id == other.id; }
+  bool operator!=(FileID other) const { return id != other.id; }
+};
+
+class SourceError : public std::exception {
+private:
+  std::string message;
+
+public:
+  SourceError(const std::string &msg) : message(msg) {}
+
+  const char *what() const throw() { return message.c_str(); }
+};
+
+// Offsets at which each line of `contents` starts, the first being 0
+std::vector<uint32_t> find_line_starts(std::string_view contents);
+
+// A loaded source file. Its contents are either a read-only mapping of the
+// file or a heap buffer (pipes, stdin, in-memory sources). In both cases at
+// least `SourceManager::padding` zero bytes follow the end of the contents.
+class SourceFile {
+public:
+  SourceFile(FileID id, std::string name, const char *data, size_t size,
+             void *mapping, size_t mapping_size,
+             std::unique_ptr<char[]> owned);
+  SourceFile(SourceFile &&) = delete;
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(SourceFile &&) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+  ~SourceFile();
+
+  FileID get_id() const { return id; }
+  const std::string &get_name() const { return name; }
+  std::string_view contents() const { return std::string_view(data, size); }
+  bool is_mapped() const { return mapping != nullptr; }
+
+  /* Lines and columns are 1-based, offsets are 0-based */
+  size_t line_of(size_t offset) const;
+  std::pair<size_t, size_t> line_col(size_t offset) const;
+  const std::vector<uint32_t> &get_line_starts() const;
+
+private:
+  FileID id;
+  std::string name;
+  const char *data;
+  size_t size;
+
+  void *mapping;
+  size_t mapping_size;
+  std::unique_ptr<char[]> owned;
+
+  mutable std::once_flag lines_once;
+  mutable std::vector<uint32_t> line_starts;
+};
+
+class SourceManager {
+public:
+  static constexpr size_t padding = 64;
+
+  SourceManager() = default;
+  SourceManager(SourceManager &&) = default;
+  SourceManager(const SourceManager &) = delete;
+  SourceManager &operator=(SourceManager &&) = default;
+  SourceManager &operator=(const SourceManager &) = delete;
+  ~SourceManager() = default;
+
+  // Maps regular files read-only and streams anything else (pipes, ttys).
+  // A path of "-" reads standard input.
+  FileID load_file(const std::string &path);
+  FileID load_stdin();
+  FileID add_buffer(const std::string &name, std::string_view contents);
+
+  const SourceFile &get(FileID file) const;
+  std::string_view contents(FileID file) const;
+  const std::string &name(FileID file) const;
+  size_t file_count() const { return files.size(); }
+
+private:
+  std::vector<std::unique_ptr<SourceFile>> files;
+
+  FileID load_stream(const std::string &name, int fd);
+  FileID add_file(std::string name, const char *data, size_t size,
+                  void *mapping, size_t mapping_size,
+                  std::unique_ptr<char[]> owned);
+};
+
+} // namespace source
+} // namespace vanadium
+
+#endif // INCLUDE_SOURCE_SOURCE_MANAGER_HPP_
@@ -0,0 +1,44 @@
+#ifndef INCLUDE_VANADIUM_SYMBOL_HPP_
+#define INCLUDE_VANADIUM_SYMBOL_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+namespace vanadium {
+
+// An interned name. Interning the same text always yields the same 32-bit
+// id, from any thread, for the lifetime of the process, and the text is
+// stored once; comparing and hashing symbols never looks at the text.
+class Symbol {
+public:
+  Symbol() : id(0) {};
+
+  static Symbol intern(std::string_view name);
+
+  std::string_view str() const;
+  uint32_t get_id() const { return id; }
+  bool is_valid() const { return id != 0; }
+
+  bool operator==(Symbol other) const { return id == other.id; }
+  bool operator!=(Symbol other) const { return id != other.id; }
+  bool operator<(Symbol other) const { return id < other.id; }
+
+private:
+  explicit Symbol(uint32_t id) : id(id) {};
+
+  uint32_t id;
+};
+
+} // namespace vanadium
+
+namespace std {
+template <> struct hash<vanadium::Symbol> {
+  size_t operator()(vanadium::Symbol symbol) const noexcept {
+    return std::hash<uint32_t>()(symbol.get_id());
+  }
+};
+} // namespace std
+
+#endif // INCLUDE_VANADIUM_SYMBOL_HPP_
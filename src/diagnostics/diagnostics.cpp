@@ -7,6 +7,15 @@
 namespace vanadium {
 namespace diagnostics {
 
+Label::Label(const std::string &msg, const source::SourceManager &sources,
+             source::FileID file, size_t offset)
+    : message(msg), title(sources.name(file)) {
+  auto [line, col] = sources.get(file).line_col(offset);
+  this->line = line;
+  this->col = col;
+  has_pos = true;
+}
+
 void Diagnostic::print(std::ostream &os) const {
   const char *color_start = "";
   const char *color_end = CRESET;
@@ -1,60 +1,167 @@
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
 
 #include "vanadium/diagnostics/diagnostics.hpp"
+#include "vanadium/parser/ast_cache.hpp"
+#include "vanadium/parser/ast_dumper.hpp"
 #include "vanadium/parser/errors.hpp"
+#include "vanadium/parser/flat_ast.hpp"
 #include "vanadium/parser/lexer.hpp"
 #include "vanadium/parser/parser.hpp"
+#include "vanadium/parser/profile.hpp"
+#include "vanadium/source/source_manager.hpp"
 
 using namespace vanadium;
 
-int main(int argc, char *argv[]) {
-  /* const std::string input = R"(*/
-  /* static func main() {*/
-  /*let loves_cxx = true;*/
-  /*throw new Exception("I hate C++") unless loves_cxx;*/
-  /*@@ throw new Exception("I hate C++") unless loves_cxx ifso println("I LOVE
-   * C++");*/
-  /* }*/
-  /*)";*/
-  const std::string input = R"(
-  from "std/IO" include println;
-
-  static func main() {
-	let
+static void report(const char *title, const parser::ParseError &e,
+                   const source::SourceManager &sources, source::FileID file) {
+  diagnostics::Diagnostic diag(diagnostics::Severity::Error, title, e.what());
+  if (e.has_offset()) {
+    diag.add_label(
+        diagnostics::Label("while compiling", sources, file, e.get_offset()));
+  } else {
+    diag.add_label(diagnostics::Label("while compiling", sources.name(file)));
+  }
+  diag.print();
+}
+
+static bool compile(const source::SourceManager &sources, source::FileID file,
+                    const parser::ParseOptions &options,
+                    const parser::AstCache &cache,
+                    const parser::DumpOptions &dump) {
+  // An unchanged source skips lexing and parsing altogether
+  std::string_view contents = sources.contents(file);
+  if (auto cached = cache.load(contents)) {
+    parser::AstDumper(std::cout, dump).dump(*cached);
+    return true;
   }
-  )";
 
   try {
-    lexer::TokenStream ts = lexer::tokenize(input);
+    lexer::TokenStream ts = lexer::tokenize(sources, file);
 
-    /*for (auto &tk : ts.get_tokens()) {*/
-    /*  tk.display();*/
+    /*for (size_t i = 0; i < ts.get_tokens().size(); i++) {*/
+    /*  ts.get_tokens().at(i).display();*/
     /*}*/
 
     try {
-      parser::Parser p(ts);
+      parser::Parser p(std::move(ts), options);
       parser::NodeStream ast = p.parse();
 
-      for (auto &node : ast.get_nodes()) {
-        std::cout << node->as_string() << std::endl;
+      for (const auto &e : p.get_errors()) {
+        report("Parse error", e, sources, file);
+      }
+      if (p.hit_error_limit()) {
+        diagnostics::Diagnostic(diagnostics::Severity::Note,
+                                "Too many errors",
+                                "stopped after " +
+                                    std::to_string(p.get_errors().size()))
+            .print();
+      }
+      if (!p.get_errors().empty()) {
+        return false;
+      }
+
+      parser::FlatAst flat = parser::flatten(ast.get_nodes());
+      // Only trees without errors are kept, so a hit never has any to report
+      if (!cache.get_dir().empty()) {
+        cache.store(contents, flat);
       }
+      parser::AstDumper(std::cout, dump).dump(flat);
     } catch (const parser::ParseError &e) {
-      diagnostics::Diagnostic diag(diagnostics::Severity::Error, "Parse error",
-                                   e.what());
-      diag.add_label(
-          diagnostics::Label("input hardcoded into src/main.cpp!", "Source"));
-      diag.print();
+      report("Parse error", e, sources, file);
+      return false;
     }
   } catch (const parser::ParseError &e) {
-    diagnostics::Diagnostic diag(diagnostics::Severity::Error, "Lex error",
-                                 e.what());
+    report("Lex error", e, sources, file);
+    return false;
+  }
 
-    diag.add_label(
-        diagnostics::Label("input hardcoded into src/main.cpp!", "Source"));
-    diag.print();
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> paths;
+  parser::ParseOptions options;
+  options.recover = true;
+  std::string cache_dir = parser::AstCache::default_dir();
+  parser::DumpOptions dump;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.rfind("--max-errors=", 0) == 0) {
+      options.max_errors = std::strtoul(arg.c_str() + 13, nullptr, 10);
+      // 0 means no cap
+      if (options.max_errors == 0) {
+        options.max_errors = SIZE_MAX;
+      }
+    } else if (arg == "--profile-parser") {
+      if (!parser::profile::is_available()) {
+        std::cerr << "--profile-parser needs a build with "
+                     "VANADIUM_PARSER_PROFILE=ON"
+                  << std::endl;
+        return 2;
+      }
+      parser::profile::set_enabled(true);
+    } else if (arg.rfind("--ast-cache=", 0) == 0) {
+      cache_dir = arg.substr(12);
+    } else if (arg == "--no-ast-cache") {
+      cache_dir.clear();
+    } else if (arg == "--dump-ast=text") {
+      dump.format = parser::DumpFormat::Text;
+    } else if (arg == "--dump-ast=json") {
+      dump.format = parser::DumpFormat::Json;
+    } else if (arg == "--dump-ast=sexpr") {
+      dump.format = parser::DumpFormat::SExpr;
+    } else if (arg == "--dump-positions") {
+      dump.positions = true;
+    } else if (arg.rfind("--dump-depth=", 0) == 0) {
+      dump.max_depth = std::strtoul(arg.c_str() + 13, nullptr, 10);
+    } else {
+      paths.push_back(arg);
+    }
+  }
+
+  if (paths.empty()) {
+    if (isatty(STDIN_FILENO)) {
+      std::cerr << "usage: " << argv[0]
+                << " [--max-errors=N] [--profile-parser] [--ast-cache=DIR] "
+                   "[--no-ast-cache] [--dump-ast=text|json|sexpr] "
+                   "[--dump-positions] [--dump-depth=N] <file>... "
+                   "(use '-' for stdin)"
+                << std::endl;
+      return 2;
+    }
+    paths.push_back("-");
+  }
+
+  source::SourceManager sources;
+  parser::AstCache cache(cache_dir);
+  bool ok = true;
+
+  for (const auto &path : paths) {
+    source::FileID file;
+    try {
+      file = sources.load_file(path);
+    } catch (const source::SourceError &e) {
+      diagnostics::Diagnostic diag(diagnostics::Severity::Error,
+                                   "Cannot read source", e.what());
+      diag.print();
+      ok = false;
+      continue;
+    }
+
+    ok = compile(sources, file, options, cache, dump) && ok;
+  }
+
+  if (parser::profile::is_enabled()) {
+    parser::profile::dump(std::cerr);
   }
 
-  return 0;
+  return ok ? 0 : 1;
 }
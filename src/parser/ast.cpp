@@ -1,8 +1,38 @@
 #include "vanadium/parser/ast.hpp"
+#include "vanadium/parser/ast_dumper.hpp"
+#include "vanadium/parser/flat_ast.hpp"
+#include <mutex>
+#include <sstream>
 #include <string>
 namespace vanadium {
 namespace parser {
 
+const std::string Node::as_string() {
+  FlatAst ast = flatten({this});
+  std::ostringstream out;
+  {
+    AstDumper dumper(out);
+    dumper.dump(ast, ast.roots()[0]);
+  }
+  return out.str();
+}
+
+NodeP DeferredNode::get() {
+  std::lock_guard<std::mutex> guard(lock);
+  if (!node) {
+    if (!arena) {
+      arena = std::make_shared<AstArena>();
+    }
+    node = parse(arena);
+  }
+  return node;
+}
+
+bool DeferredNode::is_parsed() {
+  std::lock_guard<std::mutex> guard(lock);
+  return node != nullptr;
+}
+
 std::string node_kind_as_string(NodeKind kind) {
   if (node_kind_map.count(kind) > 0) {
     return node_kind_map.at(kind);
@@ -0,0 +1,91 @@
+#include "vanadium/parser/ast_arena.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace vanadium {
+namespace parser {
+
+AstArena::~AstArena() {
+  for (auto it = owned.rbegin(); it != owned.rend(); ++it) {
+    it->destroy(it->object);
+  }
+  for (const Chunk &chunk : chunks) {
+    munmap(chunk.base, chunk.size);
+  }
+}
+
+void *AstArena::allocate_chunk(size_t size, size_t align) {
+  size_t chunk_size = min_chunk_size;
+  for (size_t i = 0; i < chunks.size() && chunk_size < max_chunk_size; i++) {
+    chunk_size *= 2;
+  }
+  chunk_size = std::max(chunk_size, size + align);
+
+  void *base = mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+
+  if (!chunks.empty()) {
+    used += cursor - chunks.back().base;
+  }
+  chunks.push_back({static_cast<char *>(base), chunk_size});
+  cursor = chunks.back().base;
+  limit = cursor + chunk_size;
+  return allocate(size, align);
+}
+
+std::string_view AstArena::store(std::string_view text) {
+  if (text.empty()) {
+    return std::string_view();
+  }
+  char *stored = static_cast<char *>(allocate(text.size(), 1));
+  std::memcpy(stored, text.data(), text.size());
+  return std::string_view(stored, text.size());
+}
+
+void AstArena::adopt(AstArena &other) {
+  if (other.chunks.empty()) {
+    return;
+  }
+  // The current chunk stays last, so allocation carries on in it
+  size_t adopted = other.bytes_used();
+  if (chunks.empty()) {
+    chunks = std::move(other.chunks);
+    cursor = other.cursor;
+    limit = other.limit;
+    used = other.used;
+  } else {
+    chunks.insert(chunks.end() - 1, other.chunks.begin(),
+                  other.chunks.end());
+    used += adopted;
+  }
+  owned.insert(owned.end(), other.owned.begin(), other.owned.end());
+
+  other.chunks.clear();
+  other.owned.clear();
+  other.cursor = nullptr;
+  other.limit = nullptr;
+  other.used = 0;
+}
+
+size_t AstArena::bytes_used() const {
+  if (chunks.empty()) {
+    return 0;
+  }
+  return used + (cursor - chunks.back().base);
+}
+
+size_t AstArena::bytes_mapped() const {
+  size_t mapped = 0;
+  for (const Chunk &chunk : chunks) {
+    mapped += chunk.size;
+  }
+  return mapped;
+}
+
+} // namespace parser
+} // namespace vanadium
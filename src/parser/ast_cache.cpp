@@ -0,0 +1,221 @@
+#include "vanadium/parser/ast_cache.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vanadium {
+namespace parser {
+
+namespace {
+
+constexpr char magic[4] = {'V', 'N', 'A', 'C'};
+// Bump whenever this header changes. Changes to the trees themselves need
+// no bump, as they change the parser digest.
+constexpr uint32_t cache_version = 2;
+
+// Of the lexer and parser sources this was built from, given by CMake
+#ifndef VANADIUM_PARSER_DIGEST
+#error "VANADIUM_PARSER_DIGEST must be defined by the build"
+#endif
+constexpr uint64_t parser_digest = VANADIUM_PARSER_DIGEST;
+
+// Followed by the FlatAst encoding. Its size keeps the encoding's arrays
+// 4-byte aligned in the mapping.
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t parser_digest;
+  uint64_t source_hash;
+  uint64_t source_size;
+  // Of the encoding, so that a damaged entry is a miss rather than a
+  // different tree
+  uint64_t payload_hash;
+};
+static_assert(sizeof(Header) % alignof(uint32_t) == 0,
+              "The encoding must stay aligned after the header");
+
+uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+uint64_t fmix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// Creates `dir` and any parents it lacks
+bool make_dirs(const std::string &dir) {
+  for (size_t at = 1; at <= dir.size(); at++) {
+    if (at == dir.size() || dir[at] == '/') {
+      std::string prefix = dir.substr(0, at);
+      if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+} // namespace
+
+std::string AstCache::default_dir() {
+  if (const char *dir = std::getenv("VANADIUM_CACHE_DIR")) {
+    return dir;
+  }
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+    return std::string(xdg) + "/vanadium/ast";
+  }
+  if (const char *home = std::getenv("HOME"); home && *home) {
+    return std::string(home) + "/.cache/vanadium/ast";
+  }
+  return "";
+}
+
+// Word at a time in the manner of MurmurHash3, as it runs over every
+// source before it is parsed
+uint64_t AstCache::hash(std::string_view text) {
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  uint64_t h = text.size();
+  const char *at = text.data();
+  const char *end = at + text.size();
+
+  auto mix = [&](uint64_t k) {
+    k *= c1;
+    k = rotl(k, 31);
+    k *= c2;
+    h ^= k;
+    h = rotl(h, 27) * 5 + 0x52dce729;
+  };
+  for (; end - at >= 8; at += 8) {
+    uint64_t k;
+    std::memcpy(&k, at, sizeof(k));
+    mix(k);
+  }
+  if (at != end) {
+    uint64_t k = 0;
+    std::memcpy(&k, at, end - at);
+    mix(k);
+  }
+  return fmix(h);
+}
+
+std::string AstCache::path_for(uint64_t source_hash) const {
+  char name[24];
+  std::snprintf(name, sizeof(name), "%016llx.vnast",
+                static_cast<unsigned long long>(source_hash));
+  return dir + "/" + name;
+}
+
+std::optional<FlatAst> AstCache::load(std::string_view source) const {
+  if (dir.empty()) {
+    return std::nullopt;
+  }
+  uint64_t source_hash = hash(source);
+  std::string path = path_for(source_hash);
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+      static_cast<uint64_t>(info.st_size) < sizeof(Header)) {
+    close(fd);
+    return std::nullopt;
+  }
+
+  size_t size = info.st_size;
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return std::nullopt;
+  }
+  // Shared by every FlatAst read from the mapping, the last one unmaps it
+  std::shared_ptr<const void> mapping(
+      mapped, [size](const void *p) { munmap(const_cast<void *>(p), size); });
+
+  Header header;
+  std::memcpy(&header, mapped, sizeof(header));
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+      header.version != cache_version ||
+      header.parser_digest != parser_digest ||
+      header.source_hash != source_hash ||
+      header.source_size != source.size()) {
+    return std::nullopt;
+  }
+  std::string_view encoded(static_cast<const char *>(mapped) + sizeof(header),
+                           size - sizeof(header));
+  if (hash(encoded) != header.payload_hash) {
+    return std::nullopt;
+  }
+
+  try {
+    return FlatAst::map(encoded, std::move(mapping));
+  } catch (const std::runtime_error &) {
+    return std::nullopt;
+  }
+}
+
+// Written to a temporary file renamed over the entry, so that readers never
+// map a partly written one
+bool AstCache::store(std::string_view source, const FlatAst &ast) const {
+  if (dir.empty() || !make_dirs(dir)) {
+    return false;
+  }
+  uint64_t source_hash = hash(source);
+  std::string path = path_for(source_hash);
+  std::string temp = path + ".tmp" + std::to_string(getpid());
+
+  int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  Header header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  std::string_view encoded = ast.serialize();
+  header.version = cache_version;
+  header.parser_digest = parser_digest;
+  header.source_hash = source_hash;
+  header.source_size = source.size();
+  header.payload_hash = hash(encoded);
+
+  bool ok = write_all(fd, reinterpret_cast<const char *>(&header),
+                      sizeof(header)) &&
+            write_all(fd, encoded.data(), encoded.size());
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace parser
+} // namespace vanadium
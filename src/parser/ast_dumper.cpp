@@ -0,0 +1,636 @@
+#include "vanadium/parser/ast_dumper.hpp"
+#include "vanadium/parser/operators.hpp"
+#include "vanadium/parser/unicode.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace vanadium {
+namespace parser {
+
+namespace {
+
+struct Syntax {
+  // Before the node's kind, which is quoted in JSON
+  std::string_view node_open;
+  bool quote_kind;
+  // Around a field's name
+  std::string_view field_open;
+  std::string_view field_close;
+  std::string_view node_close;
+  // Ends a node cut off by the depth limit
+  std::string_view elided;
+  std::string_view list_open;
+  std::string_view list_separator;
+  std::string_view list_close;
+  std::string_view yes;
+  // Starts a (name, type) parameter, up to its name
+  std::string_view param_open;
+};
+
+constexpr Syntax json = {"{\"kind\":", true,      ",\"",
+                         "\":",        "}",       ",\"elided\":true}",
+                         "[",          ",",       "]",
+                         "true",       "{\"name\":"};
+constexpr Syntax sexpr = {"(",  false, " :", " ", ")", " ...)",
+                          "(",  " ",   ")",  "t", "(parameter :name "};
+
+// node_kind_as_string() without the copy
+std::string_view kind_name(NodeKind kind) {
+  auto found = node_kind_map.find(kind);
+  return found != node_kind_map.end() ? std::string_view(found->second)
+                                      : "Unknown";
+}
+
+const Syntax &syntax_of(DumpFormat format) {
+  return format == DumpFormat::Json ? json : sexpr;
+}
+
+} // namespace
+
+AstDumper::AstDumper(std::ostream &out, DumpOptions options)
+    : stream(&out), options(options) {
+  buffer.reserve(buffer_size);
+}
+
+AstDumper::AstDumper(int fd, DumpOptions options) : fd(fd), options(options) {
+  buffer.reserve(buffer_size);
+}
+
+AstDumper::~AstDumper() {
+  try {
+    flush();
+  } catch (const std::runtime_error &) {
+  }
+}
+
+void AstDumper::flush() {
+  if (buffer.empty()) {
+    return;
+  }
+  if (stream) {
+    stream->write(buffer.data(), buffer.size());
+    buffer.clear();
+    return;
+  }
+
+  const char *at = buffer.data();
+  size_t left = buffer.size();
+  while (left > 0) {
+    ssize_t written = write(fd, at, left);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      buffer.clear();
+      throw std::runtime_error(std::string("Cannot write the AST dump: ") +
+                               std::strerror(errno));
+    }
+    at += written;
+    left -= written;
+  }
+  buffer.clear();
+}
+
+void AstDumper::dump(const FlatAst &ast) {
+  for (FlatAst::Index root : ast.roots()) {
+    dump(ast, root);
+    put("\n");
+  }
+}
+
+void AstDumper::dump(const FlatAst &ast, FlatAst::Index node) {
+  work.clear();
+  work.push_back({Task::Node, node, 0, {}});
+  while (!work.empty()) {
+    Task task = work.back();
+    work.pop_back();
+    switch (task.op) {
+    case Task::Node:
+      open(ast, task.value, task.depth);
+      break;
+    case Task::Field:
+      put_field(task.text);
+      break;
+    case Task::Text:
+      put(task.text);
+      break;
+    case Task::String:
+      put_quoted(ast.string(task.value));
+      break;
+    case Task::Name:
+      put(ast.string(task.value));
+      break;
+    case Task::Modifiers:
+      put_modifiers(ast.list(task.value));
+      break;
+    }
+  }
+}
+
+void AstDumper::put_number(uint64_t number) {
+  char digits[20];
+  auto result = std::to_chars(digits, digits + sizeof(digits), number);
+  put(std::string_view(digits, result.ptr - digits));
+}
+
+// Bytes that are not part of well-formed UTF-8 are escaped as the code
+// points of the same value, so the output always is
+void AstDumper::put_quoted(std::string_view text) {
+  static const char hex[] = "0123456789abcdef";
+  put("\"");
+  size_t run = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    unsigned char c = text[i];
+    if (c >= 0x80) {
+      uint32_t code;
+      size_t length =
+          lexer::decode_utf8(text.data() + i, text.data() + text.size(), code);
+      if (length != 0) {
+        i += length - 1;
+        continue;
+      }
+    } else if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    put(text.substr(run, i - run));
+    run = i + 1;
+    switch (c) {
+    case '"':
+      put("\\\"");
+      break;
+    case '\\':
+      put("\\\\");
+      break;
+    case '\n':
+      put("\\n");
+      break;
+    case '\t':
+      put("\\t");
+      break;
+    case '\r':
+      put("\\r");
+      break;
+    default: {
+      char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+      put(std::string_view(escape, sizeof(escape)));
+    }
+    }
+  }
+  put(text.substr(run));
+  put("\"");
+}
+
+void AstDumper::put_field(std::string_view name) {
+  const Syntax &syntax = syntax_of(options.format);
+  put(syntax.field_open);
+  put(name);
+  put(syntax.field_close);
+}
+
+void AstDumper::put_flag(std::string_view name, bool set) {
+  if (set) {
+    put_field(name);
+    put(syntax_of(options.format).yes);
+  }
+}
+
+void AstDumper::put_modifiers(IndexList modifiers) {
+  bool text = options.format == DumpFormat::Text;
+  const Syntax &syntax = syntax_of(options.format);
+  put(text ? "[" : syntax.list_open);
+  for (size_t i = 0; i < modifiers.size(); i++) {
+    if (i > 0) {
+      put(text ? ",\n        " : syntax.list_separator);
+    }
+    std::string name =
+        lexer::type_as_string(static_cast<lexer::TokenType>(modifiers[i]));
+    if (text) {
+      put("'");
+      put(name);
+      put("'");
+    } else {
+      put_quoted(name);
+    }
+  }
+  put(text ? "]" : syntax.list_close);
+}
+
+void AstDumper::queue_field(std::string_view name) {
+  pending.push_back({Task::Field, 0, 0, name});
+}
+
+void AstDumper::queue_text(std::string_view text) {
+  pending.push_back({Task::Text, 0, 0, text});
+}
+
+void AstDumper::queue_child(uint32_t node, uint32_t depth) {
+  pending.push_back({Task::Node, node, depth, {}});
+}
+
+void AstDumper::queue_string(Task::Op op, uint32_t id) {
+  pending.push_back({op, id, 0, {}});
+}
+
+void AstDumper::queue_list(IndexList nodes, uint32_t depth) {
+  const Syntax &syntax = syntax_of(options.format);
+  queue_text(syntax.list_open);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    if (i > 0) {
+      queue_text(syntax.list_separator);
+    }
+    queue_child(nodes[i], depth);
+  }
+  queue_text(syntax.list_close);
+}
+
+void AstDumper::open(const FlatAst &ast, FlatAst::Index node, uint32_t depth) {
+  if (options.format == DumpFormat::Text) {
+    open_text(ast, node, depth);
+    return;
+  }
+  const Syntax &syntax = syntax_of(options.format);
+  std::string_view kind = kind_name(ast.tag(node));
+  put(syntax.node_open);
+  if (syntax.quote_kind) {
+    put_quoted(kind);
+  } else {
+    put(kind);
+  }
+  if (options.positions) {
+    put_field("pos");
+    put_number(ast.pos(node));
+  }
+  if (depth > options.max_depth) {
+    put(syntax.elided);
+    return;
+  }
+
+  auto put_strings = [&](std::string_view name, IndexList strings) {
+    put_field(name);
+    put(syntax.list_open);
+    for (size_t i = 0; i < strings.size(); i++) {
+      if (i > 0) {
+        put(syntax.list_separator);
+      }
+      put_quoted(ast.string(strings[i]));
+    }
+    put(syntax.list_close);
+  };
+  auto put_operator = [&]() {
+    put_field("op");
+    put_quoted(spelling_of(static_cast<Operator>(ast.flags_of(node))));
+  };
+
+  FlatAst::Data d = ast.data(node);
+  uint8_t flags = ast.flags_of(node);
+  uint32_t next = depth + 1;
+  pending.clear();
+  switch (ast.tag(node)) {
+  case NodeKind::Include:
+    put_field("from");
+    put_quoted(ast.string(d.lhs));
+    put_strings("includes", ast.list(d.rhs));
+    break;
+  case NodeKind::Block:
+    queue_field("inner");
+    queue_list(ast.list(d.lhs), next);
+    break;
+  case NodeKind::FuncDecl: {
+    IndexList modifiers = ast.list(d.lhs + 2);
+    IndexList params = ast.list(d.lhs + 3 + modifiers.size());
+    put_field("name");
+    put_quoted(ast.string(ast.extra(d.lhs)));
+    put_field("modifiers");
+    put_modifiers(modifiers);
+
+    queue_field("parameters");
+    queue_text(syntax.list_open);
+    // The list counts (name, type) pairs
+    for (size_t i = 0; i < params.size(); i++) {
+      if (i > 0) {
+        queue_text(syntax.list_separator);
+      }
+      queue_text(syntax.param_open);
+      queue_string(Task::String, params.begin()[2 * i]);
+      queue_field("type");
+      queue_child(params.begin()[2 * i + 1], next);
+      queue_text(syntax.node_close);
+    }
+    queue_text(syntax.list_close);
+    queue_field("ret_type");
+    queue_child(ast.extra(d.lhs + 1), next);
+    queue_field("block");
+    queue_child(d.rhs, next);
+    break;
+  }
+  case NodeKind::VarDecl:
+    put_field("name");
+    put_quoted(ast.string(ast.extra(d.rhs)));
+    put_field("modifiers");
+    put_modifiers(ast.list(d.rhs + 1));
+    put_flag("const", flags & 1);
+    put_flag("static", flags & 2);
+    queue_field("value");
+    queue_child(d.lhs, next);
+    break;
+  case NodeKind::BinaryExpr:
+    put_operator();
+    queue_field("lhs");
+    queue_child(d.lhs, next);
+    queue_field("rhs");
+    queue_child(d.rhs, next);
+    break;
+  case NodeKind::UnaryExpr:
+    put_operator();
+    queue_field("operand");
+    queue_child(d.lhs, next);
+    break;
+  case NodeKind::Literal:
+    put_field("type");
+    put_quoted(lexer::type_as_string(static_cast<lexer::TokenType>(flags)));
+    put_field("value");
+    put_quoted(ast.string(d.lhs));
+    break;
+  case NodeKind::CallExpr:
+    queue_field("callee");
+    queue_child(d.lhs, next);
+    queue_field("args");
+    queue_list(ast.list(d.rhs), next);
+    break;
+  case NodeKind::MemberAccess:
+    put_field("member");
+    put_quoted(ast.string(d.rhs));
+    queue_field("object");
+    queue_child(d.lhs, next);
+    break;
+  case NodeKind::EOI:
+    break;
+  case NodeKind::Type:
+    put_flag("const", flags & 1 << 2);
+    put_flag("comptime", flags & 1 << 3);
+    put_flag("reference", flags & 1 << 4);
+    put_flag("throwable", flags & 1 << 5);
+    put_flag("nullable", flags & 1 << 6);
+    switch (static_cast<TypeNode::TypeKind>(flags & 3)) {
+    case TypeNode::TypeKind::Simple:
+      put_field("base_name");
+      put_quoted(ast.string(d.lhs));
+      break;
+    case TypeNode::TypeKind::Array:
+      if (d.rhs != FlatAst::none) {
+        put_field("array_size");
+        put_number(d.rhs);
+      }
+      queue_field("element_type");
+      queue_child(d.lhs, next);
+      break;
+    case TypeNode::TypeKind::Map:
+      queue_field("key_type");
+      queue_child(d.lhs, next);
+      queue_field("value_type");
+      queue_child(d.rhs, next);
+      break;
+    }
+    break;
+  case NodeKind::ImplicitReturn:
+    queue_field("value");
+    queue_child(d.lhs, next);
+    break;
+  case NodeKind::NewExpr:
+    queue_field("type");
+    queue_child(d.lhs, next);
+    queue_field("args");
+    queue_list(ast.list(d.rhs), next);
+    break;
+  case NodeKind::Throw:
+    queue_field("operand");
+    queue_child(d.lhs, next);
+    break;
+  case NodeKind::UnlessExpr:
+    queue_field("lhs");
+    queue_child(d.lhs, next);
+    queue_field("rhs");
+    queue_child(ast.extra(d.rhs), next);
+    if (flags & 1) {
+      queue_field("ifso");
+      queue_child(ast.extra(d.rhs + 1), next);
+    }
+    break;
+  case NodeKind::Error:
+    put_field("message");
+    put_quoted(ast.string(d.lhs));
+    if (d.rhs != FlatAst::none) {
+      put_field("offset");
+      put_number(d.rhs);
+    }
+    break;
+  }
+  queue_text(syntax.node_close);
+  work.insert(work.end(), pending.rbegin(), pending.rend());
+}
+
+// The fields, their order and the odd missing colon or line break are those
+// as_string() has always had
+void AstDumper::open_text(const FlatAst &ast, FlatAst::Index node,
+                          uint32_t depth) {
+  NodeKind kind = ast.tag(node);
+  put(kind == NodeKind::NewExpr ? "Node(Kind '" : "Node(Kind: '");
+  put(kind_name(kind));
+  put("'");
+  if (options.positions) {
+    put(", Pos: ");
+    put_number(ast.pos(node));
+  }
+  if (depth > options.max_depth) {
+    put(", ...)");
+    return;
+  }
+
+  auto queue_items = [&](IndexList nodes, std::string_view open) {
+    queue_text(open);
+    for (uint32_t item : nodes) {
+      queue_text("  ");
+      queue_child(item, depth + 1);
+      queue_text(",\n");
+    }
+    queue_text("])");
+  };
+
+  FlatAst::Data d = ast.data(node);
+  uint8_t flags = ast.flags_of(node);
+  uint32_t next = depth + 1;
+  pending.clear();
+  switch (kind) {
+  case NodeKind::Include: {
+    IndexList names = ast.list(d.rhs);
+    put(", From: '");
+    put(ast.string(d.lhs));
+    put("', Includes: [");
+    for (size_t i = 0; i < names.size(); i++) {
+      if (i > 0) {
+        put(",\n        ");
+      }
+      put("'");
+      put(ast.string(names[i]));
+      put("'");
+    }
+    put("])");
+    break;
+  }
+  case NodeKind::Block:
+    queue_items(ast.list(d.lhs), ", Inner: [\n");
+    break;
+  case NodeKind::FuncDecl: {
+    IndexList modifiers = ast.list(d.lhs + 2);
+    IndexList params = ast.list(d.lhs + 3 + modifiers.size());
+    put(", Name: '");
+    put(ast.string(ast.extra(d.lhs)));
+    put("', Modifiers: ");
+    put_modifiers(modifiers);
+    put(", Block: ");
+    queue_child(d.rhs, next);
+    queue_text(", Params: ");
+    // The list counts (name, type) pairs
+    for (size_t i = 0; i < params.size(); i++) {
+      if (i > 0) {
+        queue_text(", ");
+      }
+      queue_string(Task::Name, params.begin()[2 * i]);
+      queue_text(": ");
+      queue_child(params.begin()[2 * i + 1], next);
+    }
+    if (params.empty()) {
+      queue_text("None");
+    }
+    queue_text(", Returns: ");
+    queue_child(ast.extra(d.lhs + 1), next);
+    queue_text(")");
+    break;
+  }
+  case NodeKind::VarDecl:
+    put(", Name: '");
+    put(ast.string(ast.extra(d.rhs)));
+    put("', Value: ");
+    queue_child(d.lhs, next);
+    queue_text(", Modifiers: ");
+    queue_string(Task::Modifiers, d.rhs + 1);
+    queue_text(flags & 1 ? ", Constant: yes" : ", Constant: no");
+    queue_text(flags & 2 ? ", Static: yes)" : ", Static: no)");
+    break;
+  case NodeKind::BinaryExpr:
+    put(", Left: ");
+    queue_child(d.lhs, next);
+    queue_text(", Right: ");
+    queue_child(d.rhs, next);
+    queue_text(", Operator: '");
+    queue_text(spelling_of(static_cast<Operator>(flags)));
+    queue_text("')");
+    break;
+  case NodeKind::UnaryExpr:
+    put(", Operator: '");
+    put(spelling_of(static_cast<Operator>(flags)));
+    put("', Operand: ");
+    queue_child(d.lhs, next);
+    queue_text(")");
+    break;
+  case NodeKind::Literal:
+    put(", Type: '");
+    put(lexer::type_as_string(static_cast<lexer::TokenType>(flags)));
+    put("', Value: '");
+    put(ast.string(d.lhs));
+    put("')");
+    break;
+  case NodeKind::CallExpr:
+    put(", Callee: ");
+    queue_child(d.lhs, next);
+    queue_items(ast.list(d.rhs), ", Args: [\n");
+    break;
+  case NodeKind::MemberAccess:
+    put(", Object: ");
+    queue_child(d.lhs, next);
+    queue_text(", Member: '");
+    queue_string(Task::Name, d.rhs);
+    queue_text("')");
+    break;
+  case NodeKind::EOI:
+    put(")");
+    break;
+  case NodeKind::Type:
+    put(", Value: '");
+    if (flags & 1 << 2)
+      put("const ");
+    if (flags & 1 << 3)
+      put("comptime ");
+    if (flags & 1 << 4)
+      put("&");
+    if (flags & 1 << 5)
+      put("!");
+    switch (static_cast<TypeNode::TypeKind>(flags & 3)) {
+    case TypeNode::TypeKind::Simple:
+      put(ast.string(d.lhs));
+      break;
+    case TypeNode::TypeKind::Array:
+      put("[");
+      if (d.rhs != FlatAst::none) {
+        put_number(d.rhs);
+      }
+      put("]");
+      queue_child(d.lhs, next);
+      break;
+    case TypeNode::TypeKind::Map:
+      put("{");
+      queue_child(d.lhs, next);
+      queue_text("}");
+      queue_child(d.rhs, next);
+      break;
+    }
+    queue_text(flags & 1 << 6 ? "?')" : "')");
+    break;
+  case NodeKind::ImplicitReturn:
+    put(", Value: ");
+    queue_child(d.lhs, next);
+    queue_text(")");
+    break;
+  case NodeKind::NewExpr:
+    put(", Type: ");
+    queue_child(d.lhs, next);
+    queue_items(ast.list(d.rhs), ", Args: [");
+    break;
+  case NodeKind::Throw:
+    put(", Throwed: ");
+    queue_child(d.lhs, next);
+    queue_text(")");
+    break;
+  case NodeKind::UnlessExpr:
+    put(", Left: ");
+    queue_child(d.lhs, next);
+    queue_text(", Right: ");
+    queue_child(ast.extra(d.rhs), next);
+    if (flags & 1) {
+      queue_text(", Ifso: ");
+      queue_child(ast.extra(d.rhs + 1), next);
+    }
+    queue_text(")");
+    break;
+  case NodeKind::Error:
+    put(", Message: '");
+    put(ast.string(d.lhs));
+    put("')");
+    break;
+  }
+  work.insert(work.end(), pending.rbegin(), pending.rend());
+}
+
+void dump(const std::vector<NodeP> &roots, std::ostream &out,
+          DumpOptions options) {
+  AstDumper dumper(out, options);
+  dumper.dump(flatten(roots));
+  dumper.flush();
+}
+
+} // namespace parser
+} // namespace vanadium
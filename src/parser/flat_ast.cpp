@@ -0,0 +1,546 @@
+#include "vanadium/parser/flat_ast.hpp"
+#include "vanadium/parser/ast_dumper.hpp"
+#include "vanadium/parser/ast_visitor.hpp"
+#include "vanadium/parser/operators.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace vanadium {
+namespace parser {
+
+namespace {
+
+constexpr char magic[4] = {'V', 'N', 'F', 'A'};
+constexpr uint32_t format_version = 1;
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t nodes;
+  uint32_t extra;
+  uint32_t strings;
+  uint32_t string_bytes;
+};
+
+// The arrays of a FlatAst while they are being built
+struct Arrays {
+  std::vector<NodeKind> tags;
+  std::vector<uint8_t> flags;
+  std::vector<uint32_t> positions;
+  std::vector<FlatAst::Data> datas;
+  std::vector<uint32_t> extra_data = {0};
+  std::vector<uint32_t> string_starts = {0};
+  std::string string_bytes;
+
+  std::string encode() const;
+};
+
+// Four-byte arrays first, so they stay aligned when the bytes are mapped
+std::string Arrays::encode() const {
+  Header header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = format_version;
+  header.nodes = static_cast<uint32_t>(tags.size());
+  header.extra = static_cast<uint32_t>(extra_data.size());
+  header.strings = static_cast<uint32_t>(string_starts.size());
+  header.string_bytes = static_cast<uint32_t>(string_bytes.size());
+
+  std::string out;
+  out.reserve(sizeof(header) +
+              tags.size() * (sizeof(NodeKind) + sizeof(uint8_t) +
+                             sizeof(uint32_t) + sizeof(FlatAst::Data)) +
+              (extra_data.size() + string_starts.size()) * sizeof(uint32_t) +
+              string_bytes.size());
+  auto put = [&](const void *data, size_t size) {
+    out.append(static_cast<const char *>(data), size);
+  };
+  put(&header, sizeof(header));
+  put(positions.data(), positions.size() * sizeof(uint32_t));
+  put(datas.data(), datas.size() * sizeof(FlatAst::Data));
+  put(extra_data.data(), extra_data.size() * sizeof(uint32_t));
+  put(string_starts.data(), string_starts.size() * sizeof(uint32_t));
+  put(tags.data(), tags.size());
+  put(flags.data(), flags.size());
+  put(string_bytes.data(), string_bytes.size());
+  return out;
+}
+
+uint32_t type_flags(const TypeNode *type) {
+  return static_cast<uint32_t>(type->type_kind) | type->is_const << 2 |
+         type->is_comptime << 3 | type->is_reference << 4 |
+         type->is_throwable << 5 | type->is_nullable << 6;
+}
+
+} // namespace
+
+// Numbers nodes in the order it reaches them, parents before children, and
+// keeps the ones still to encode on a stack of its own, so that a deep tree
+// takes no deep recursion
+class Flattener : public ASTVisitor<Flattener> {
+public:
+  FlatAst run(const std::vector<NodeP> &roots) {
+    std::vector<uint32_t> indices;
+    for (NodeP root : roots) {
+      indices.push_back(reserve(root));
+    }
+    ast.extra_data[0] = static_cast<uint32_t>(indices.size());
+    ast.extra_data.insert(ast.extra_data.end(), indices.begin(),
+                          indices.end());
+
+    while (!work.empty()) {
+      auto item = work.back();
+      work.pop_back();
+      current = item.second;
+      visit(item.first);
+    }
+    auto encoded = std::make_shared<const std::string>(ast.encode());
+    return FlatAst(*encoded, encoded);
+  }
+
+  void visit_include(IncludeNode *node) {
+    uint32_t names = static_cast<uint32_t>(ast.extra_data.size());
+    ast.extra_data.push_back(static_cast<uint32_t>(node->includes.size()));
+    for (Symbol name : node->includes) {
+      ast.extra_data.push_back(string(name.str()));
+    }
+    set(0, string(node->from), names);
+  }
+
+  void visit_block(BlockNode *node) {
+    set(0, list(node->inner), FlatAst::none);
+  }
+
+  void visit_funcdecl(FuncDeclNode *node) {
+    uint32_t ret_type = child(node->ret_type);
+    uint32_t block = child(node->get_block());
+    std::vector<uint32_t> params;
+    for (const auto &param : node->parameters) {
+      params.push_back(string(param.first.str()));
+      params.push_back(child(param.second));
+    }
+
+    uint32_t extra = static_cast<uint32_t>(ast.extra_data.size());
+    ast.extra_data.push_back(string(node->name.str()));
+    ast.extra_data.push_back(ret_type);
+    push_modifiers(node->modfs);
+    ast.extra_data.push_back(static_cast<uint32_t>(node->parameters.size()));
+    ast.extra_data.insert(ast.extra_data.end(), params.begin(), params.end());
+    set(0, extra, block);
+  }
+
+  void visit_vardecl(VarDeclNode *node) {
+    uint32_t value = child(node->value);
+    uint32_t extra = static_cast<uint32_t>(ast.extra_data.size());
+    ast.extra_data.push_back(string(node->name.str()));
+    push_modifiers(node->modfs);
+    set(node->is_const | node->is_static << 1, value, extra);
+  }
+
+  void visit_binary(BinaryExprNode *node) {
+    uint32_t lhs = child(node->lhs);
+    uint32_t rhs = child(node->rhs);
+    set(static_cast<uint8_t>(operator_spelled(node->op)), lhs, rhs);
+  }
+
+  void visit_unary(UnaryExprNode *node) {
+    set(static_cast<uint8_t>(operator_spelled(node->op)), child(node->operand),
+        FlatAst::none);
+  }
+
+  void visit_literal(LiteralNode *node) {
+    uint32_t number = FlatAst::none;
+    if (node->type == lexer::TokenType::Int ||
+        node->type == lexer::TokenType::Float) {
+      uint64_t floating;
+      std::memcpy(&floating, &node->number.floating, sizeof(floating));
+      number = static_cast<uint32_t>(ast.extra_data.size());
+      ast.extra_data.insert(
+          ast.extra_data.end(),
+          {static_cast<uint32_t>(node->number.integer),
+           static_cast<uint32_t>(node->number.integer >> 32),
+           static_cast<uint32_t>(floating),
+           static_cast<uint32_t>(floating >> 32),
+           node->number.bits | uint32_t(node->number.is_unsigned) << 8});
+    }
+    set(static_cast<uint8_t>(node->type), string(node->value), number);
+  }
+
+  void visit_call(CallExprNode *node) {
+    uint32_t callee = child(node->callee);
+    set(0, callee, list(node->args));
+  }
+
+  void visit_member(MemberAccessNode *node) {
+    set(0, child(node->object), string(node->member.str()));
+  }
+
+  void visit_eoi(EOINode *) { set(0, FlatAst::none, FlatAst::none); }
+
+  void visit_type(TypeNode *node) {
+    uint32_t size =
+        node->array_size < 0 ? FlatAst::none : node->array_size;
+    switch (node->type_kind) {
+    case TypeNode::TypeKind::Simple:
+      set(type_flags(node), string(node->base_name), size);
+      break;
+    case TypeNode::TypeKind::Array:
+      set(type_flags(node), child(node->element_type), size);
+      break;
+    case TypeNode::TypeKind::Map: {
+      uint32_t key = child(node->key_type);
+      set(type_flags(node), key, child(node->value_type));
+      break;
+    }
+    }
+  }
+
+  void visit_implicit_return(ImplicitReturnNode *node) {
+    set(0, child(node->value), FlatAst::none);
+  }
+
+  void visit_new(NewExprNode *node) {
+    uint32_t type = child(node->type);
+    set(0, type, list(node->args));
+  }
+
+  void visit_throw(ThrowNode *node) {
+    set(0, child(node->operand), FlatAst::none);
+  }
+
+  void visit_unless(UnlessExprNode *node) {
+    uint32_t lhs = child(node->lhs);
+    uint32_t rhs = child(node->rhs);
+    uint32_t ifso = node->has_ifso ? child(node->ifso) : FlatAst::none;
+    uint32_t extra = static_cast<uint32_t>(ast.extra_data.size());
+    ast.extra_data.insert(ast.extra_data.end(), {rhs, ifso});
+    set(node->has_ifso, lhs, extra);
+  }
+
+  void visit_error(ErrorNode *node) {
+    set(0, string(node->message),
+        node->offset < 0 ? FlatAst::none : static_cast<uint32_t>(node->offset));
+  }
+
+private:
+  Arrays ast;
+  std::vector<std::pair<NodeP, uint32_t>> work;
+  std::unordered_map<std::string_view, uint32_t> strings;
+  // The node being encoded
+  uint32_t current = 0;
+
+  // Gives `node` the next index, to be encoded once popped off `work`
+  uint32_t reserve(NodeP node) {
+    uint32_t index = static_cast<uint32_t>(ast.tags.size());
+    ast.tags.push_back(node->kind);
+    ast.flags.push_back(0);
+    ast.positions.push_back(node->pos);
+    ast.datas.push_back({FlatAst::none, FlatAst::none});
+    work.emplace_back(node, index);
+    return index;
+  }
+
+  uint32_t child(NodeP node) { return node ? reserve(node) : FlatAst::none; }
+
+  uint32_t list(ArenaSpan<NodeP> nodes) {
+    uint32_t at = static_cast<uint32_t>(ast.extra_data.size());
+    ast.extra_data.push_back(static_cast<uint32_t>(nodes.size()));
+    for (NodeP node : nodes) {
+      ast.extra_data.push_back(child(node));
+    }
+    return at;
+  }
+
+  void push_modifiers(ArenaSpan<lexer::TokenType> modifiers) {
+    ast.extra_data.push_back(static_cast<uint32_t>(modifiers.size()));
+    for (lexer::TokenType modifier : modifiers) {
+      ast.extra_data.push_back(static_cast<uint32_t>(modifier));
+    }
+  }
+
+  // Equal strings share an id, and the views stay valid while flattening
+  uint32_t string(std::string_view text) {
+    auto found = strings.find(text);
+    if (found != strings.end()) {
+      return found->second;
+    }
+    uint32_t id = static_cast<uint32_t>(ast.string_starts.size() - 1);
+    ast.string_bytes += text;
+    ast.string_starts.push_back(static_cast<uint32_t>(ast.string_bytes.size()));
+    strings.emplace(text, id);
+    return id;
+  }
+
+  void set(uint8_t node_flags, uint32_t lhs, uint32_t rhs) {
+    ast.flags[current] = node_flags;
+    ast.datas[current] = {lhs, rhs};
+  }
+};
+
+FlatAst flatten(const std::vector<NodeP> &roots) {
+  return Flattener().run(roots);
+}
+
+std::string FlatAst::as_string(Index node) const {
+  std::ostringstream out;
+  {
+    AstDumper dumper(out);
+    dumper.dump(*this, node);
+  }
+  return out.str();
+}
+
+/* Serialization */
+
+FlatAst::FlatAst() : FlatAst(empty_encoding(), nullptr) {}
+
+FlatAst::FlatAst(std::string_view bytes, std::shared_ptr<const void> owner)
+    : owner(std::move(owner)), encoded(bytes) {
+  Header header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  node_count = header.nodes;
+  extra_count = header.extra;
+  string_count = header.strings;
+  string_byte_count = header.string_bytes;
+
+  const char *at = bytes.data() + sizeof(header);
+  auto take = [&](auto &array, size_t count) {
+    array = reinterpret_cast<std::remove_reference_t<decltype(array)>>(at);
+    at += count * sizeof(*array);
+  };
+  take(positions, node_count);
+  take(datas, node_count);
+  take(extra_data, extra_count);
+  take(string_starts, string_count);
+  take(tags, node_count);
+  take(flags, node_count);
+  take(string_bytes, string_byte_count);
+}
+
+std::string_view FlatAst::empty_encoding() {
+  static const std::string encoded = Arrays().encode();
+  return encoded;
+}
+
+FlatAst FlatAst::deserialize(std::string_view bytes) {
+  auto copy = std::make_shared<const std::string>(bytes);
+  return map(*copy, copy);
+}
+
+FlatAst FlatAst::map(std::string_view bytes,
+                     std::shared_ptr<const void> owner) {
+  Header header;
+  if (bytes.size() < sizeof(header)) {
+    throw std::runtime_error("Flat AST is truncated");
+  }
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+      header.version != format_version) {
+    throw std::runtime_error("Not a flat AST of this version");
+  }
+
+  uint64_t expected = sizeof(header) +
+                      uint64_t(header.nodes) * (sizeof(uint32_t) +
+                                                sizeof(Data) + 2) +
+                      (uint64_t(header.extra) + header.strings) *
+                          sizeof(uint32_t) +
+                      header.string_bytes;
+  if (bytes.size() != expected) {
+    throw std::runtime_error("Flat AST is truncated");
+  }
+  // A std::string of the encoding is always aligned well enough
+  if (reinterpret_cast<uintptr_t>(bytes.data()) % alignof(uint32_t) != 0) {
+    return deserialize(bytes);
+  }
+
+  FlatAst ast(bytes, std::move(owner));
+  ast.check();
+  return ast;
+}
+
+// Checks that every index is in range, every node but the roots has one
+// parent which comes before it, and every enum stored is one of its values,
+// so no walk can read out of bounds, loop or visit a node twice, and no
+// name lookup can miss
+void FlatAst::check() const {
+  auto fail = []() {
+    throw std::runtime_error("Flat AST has an index or value out of range");
+  };
+
+  if (extra_count == 0 || string_count == 0 || string_starts[0] != 0 ||
+      string_starts[string_count - 1] != string_byte_count) {
+    fail();
+  }
+  for (size_t i = 1; i < string_count; i++) {
+    if (string_starts[i] < string_starts[i - 1]) {
+      fail();
+    }
+  }
+
+  size_t strings = string_count - 1;
+  auto check_string = [&](uint32_t id) {
+    if (id >= strings) {
+      fail();
+    }
+  };
+  // `count` words from `from` on are extra_data
+  auto check_extra = [&](uint64_t from, uint64_t count) {
+    if (from + count > extra_count) {
+      fail();
+    }
+  };
+  auto check_list = [&](uint32_t at, uint32_t width) {
+    check_extra(at, 1);
+    check_extra(uint64_t(at) + 1, uint64_t(extra_data[at]) * width);
+  };
+  // Whether each node is a root or has been seen as a child
+  std::vector<bool> reached(node_count);
+  auto check_child = [&](size_t parent, uint32_t child, bool optional) {
+    if (child == none) {
+      if (!optional) {
+        fail();
+      }
+    } else if (child <= parent || child >= node_count || reached[child]) {
+      fail();
+    } else {
+      reached[child] = true;
+    }
+  };
+  auto check_children = [&](size_t parent, uint32_t at) {
+    check_list(at, 1);
+    for (uint32_t child : list(at)) {
+      check_child(parent, child, false);
+    }
+  };
+  auto check_token_type = [&](uint32_t type) {
+    if (type > static_cast<uint32_t>(lexer::TokenType::EOS)) {
+      fail();
+    }
+  };
+  auto check_modifiers = [&](uint32_t at) {
+    check_list(at, 1);
+    for (uint32_t modifier : list(at)) {
+      check_token_type(modifier);
+    }
+  };
+  auto check_operator = [&](uint8_t op) {
+    if (op >= operator_count) {
+      fail();
+    }
+  };
+
+  check_list(0, 1);
+  for (uint32_t root : roots()) {
+    if (root >= node_count || reached[root]) {
+      fail();
+    }
+    reached[root] = true;
+  }
+
+  for (size_t i = 0; i < node_count; i++) {
+    // Its parent, if any, was checked before it
+    if (!reached[i]) {
+      fail();
+    }
+    Data d = datas[i];
+    switch (tags[i]) {
+    case NodeKind::Include:
+      check_string(d.lhs);
+      check_list(d.rhs, 1);
+      for (uint32_t name : list(d.rhs)) {
+        check_string(name);
+      }
+      break;
+    case NodeKind::Block:
+      check_children(i, d.lhs);
+      break;
+    case NodeKind::FuncDecl: {
+      check_child(i, d.rhs, false);
+      check_extra(d.lhs, 3);
+      check_string(extra_data[d.lhs]);
+      check_child(i, extra_data[d.lhs + 1], false);
+      uint32_t params = d.lhs + 2;
+      check_modifiers(params);
+      params += 1 + extra_data[params];
+      check_list(params, 2);
+      IndexList pairs = list(params);
+      for (size_t p = 0; p < pairs.size(); p++) {
+        check_string(pairs.begin()[2 * p]);
+        check_child(i, pairs.begin()[2 * p + 1], false);
+      }
+      break;
+    }
+    case NodeKind::VarDecl:
+      check_child(i, d.lhs, false);
+      check_extra(d.rhs, 2);
+      check_string(extra_data[d.rhs]);
+      check_modifiers(d.rhs + 1);
+      break;
+    case NodeKind::BinaryExpr:
+      check_operator(flags[i]);
+      check_child(i, d.lhs, false);
+      check_child(i, d.rhs, false);
+      break;
+    case NodeKind::UnaryExpr:
+      check_operator(flags[i]);
+      check_child(i, d.lhs, false);
+      break;
+    case NodeKind::ImplicitReturn:
+    case NodeKind::Throw:
+      check_child(i, d.lhs, false);
+      break;
+    case NodeKind::Literal:
+      check_token_type(flags[i]);
+      check_string(d.lhs);
+      if (d.rhs != none) {
+        check_extra(d.rhs, 5);
+      }
+      break;
+    case NodeKind::CallExpr:
+    case NodeKind::NewExpr:
+      check_child(i, d.lhs, false);
+      check_children(i, d.rhs);
+      break;
+    case NodeKind::MemberAccess:
+      check_child(i, d.lhs, false);
+      check_string(d.rhs);
+      break;
+    case NodeKind::EOI:
+      break;
+    case NodeKind::Type:
+      switch (static_cast<TypeNode::TypeKind>(flags[i] & 3)) {
+      case TypeNode::TypeKind::Simple:
+        check_string(d.lhs);
+        break;
+      case TypeNode::TypeKind::Array:
+        check_child(i, d.lhs, false);
+        break;
+      case TypeNode::TypeKind::Map:
+        check_child(i, d.lhs, false);
+        check_child(i, d.rhs, false);
+        break;
+      default:
+        fail();
+      }
+      break;
+    case NodeKind::UnlessExpr:
+      check_child(i, d.lhs, false);
+      check_extra(d.rhs, 2);
+      check_child(i, extra_data[d.rhs], false);
+      check_child(i, extra_data[d.rhs + 1], true);
+      break;
+    case NodeKind::Error:
+      check_string(d.lhs);
+      break;
+    default:
+      fail();
+    }
+  }
+}
+
+} // namespace parser
+} // namespace vanadium
@@ -1,171 +1,1137 @@
 #include "vanadium/parser/lexer.hpp"
+#include "vanadium/parser/charclass.hpp"
 #include "vanadium/parser/errors.hpp"
+#include "vanadium/parser/keywords.hpp"
+#include "vanadium/parser/scan.hpp"
+#include "vanadium/parser/unicode.hpp"
 #include "vanadium/util_macros.hpp"
 
-#include <cctype>
+#include <algorithm>
+#include <charconv>
 #include <cstddef>
 #include <cstdio>
 #include <cstring>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <thread>
 
 namespace vanadium {
 namespace lexer {
 
 /*  TokenStream methods */
-Token TokenStream::next() {
+const Token &TokenStream::at(size_t index) {
+  Token &slot = ring[index % lookahead];
+
+  if (!lexer) {
+    size_t &held = ring_index[index % lookahead];
+    if (held != index) {
+      slot = tokens->at(std::min(index, last));
+      if (index >= last) {
+        // The end of the list, or of the range the stream walks
+        Token eoi;
+        eoi.pos = TokenPos(slot.pos.from, slot.pos.from, slot.pos.line);
+        slot = eoi;
+      }
+      held = index;
+    }
+    return slot;
+  }
+
+  if (index + lookahead < pulled) {
+    throw std::out_of_range("Token is no longer in the lookahead buffer");
+  }
+  if (index >= current + lookahead) {
+    throw std::out_of_range("Token is beyond the lookahead buffer");
+  }
+
+  while (pulled <= index) {
+    ring[pulled % lookahead] = lexer->next_token();
+    pulled++;
+  }
+  return slot;
+}
+
+const Token &TokenStream::next() {
   current++;
-  return tokens.at(current);
+  return at(current);
 }
-Token TokenStream::get() { return tokens.at(current); }
+const Token &TokenStream::get() { return at(current); }
 
-bool TokenStream::has_next() { return tokens.size() > current + 1; }
+bool TokenStream::has_next() {
+  if (lexer) {
+    return get().kind != TokenType::EOI;
+  }
+  return last > current;
+}
 bool TokenStream::next_is_eoi() {
   return has_next() && peek(1).kind != TokenType::EOI;
 };
 
-Token TokenStream::peek(size_t offset = 1) {
-  return tokens.at(current + offset);
+const Token &TokenStream::peek(size_t offset) { return at(current + offset); }
+
+void TokenStream::rewind(size_t checkpoint) {
+  if (checkpoint > current) {
+    throw std::out_of_range("Cannot rewind to a token not yet reached");
+  }
+  if (lexer && checkpoint + lookahead < pulled) {
+    throw std::out_of_range("Checkpoint is no longer in the lookahead buffer");
+  }
+  current = checkpoint;
+}
+
+void TokenStream::skip_to(size_t index) {
+  if (lexer) {
+    throw std::logic_error("Cannot skip tokens of a streaming TokenStream");
+  }
+  current = std::max(current, std::min(index, last));
 }
 
 const size_t TokenStream::get_index() { return current; }
-const TokenList TokenStream::get_tokens() { return tokens; }
+const TokenList &TokenStream::get_tokens() { return *tokens; }
 
-/* Main lexer logic */
-#define PUSH_TOKEN(TOKEN)                                                      \
-  tokens.push_back(TOKEN);                                                     \
-  continue;
+const std::shared_ptr<StringArena> &TokenStream::get_strings() const {
+  return lexer ? lexer->get_strings() : tokens->get_strings();
+}
+
+// Whether the string spanning `raw` (quotes included) has its closing
+// quote, which an odd run of backslashes in front of it would escape
+static bool is_terminated(std::string_view raw) {
+  if (raw.size() < 2 || raw.back() != '"') {
+    return false;
+  }
+  size_t backslashes = 0;
+  while (backslashes + 2 < raw.size() &&
+         raw[raw.size() - 2 - backslashes] == '\\') {
+    backslashes++;
+  }
+  return backslashes % 2 == 0;
+}
+
+// Builds the token of `kind` spanning [from, to) of `input`
+static Token make_token(std::string_view input, TokenType kind, size_t from,
+                        size_t to, size_t line) {
+  std::string_view lexeme = input.substr(from, to - from);
+
+  // The lexeme excludes the quotes, the position includes them
+  if (kind == TokenType::String) {
+    bool terminated = is_terminated(lexeme);
+    lexeme.remove_prefix(1);
+    if (terminated) {
+      lexeme.remove_suffix(1);
+    }
+  }
+
+  Token tk(kind, lexeme, from, to, line);
+  if (kind == TokenType::Ident) {
+    tk.symbol = Symbol::intern(lexeme);
+  } else if (kind == TokenType::String) {
+    tk.text = lexeme;
+  }
+  return tk;
+}
+
+/* Side tables, mapping ascending token indices to values */
+template <typename T>
+static const T *side_table_find(const std::vector<uint32_t> &indices,
+                                const std::vector<T> &values, size_t index) {
+  auto found = std::lower_bound(indices.begin(), indices.end(), index);
+  if (found == indices.end() || *found != index) {
+    return nullptr;
+  }
+  return &values[found - indices.begin()];
+}
+
+// Appends the entries of tokens from `first` on, which land at `base`
+template <typename T>
+static void side_table_append(std::vector<uint32_t> &indices,
+                              std::vector<T> &values,
+                              const std::vector<uint32_t> &other_indices,
+                              const std::vector<T> &other_values,
+                              size_t first, size_t base) {
+  auto entry = std::lower_bound(other_indices.begin(), other_indices.end(),
+                                first);
+  for (; entry != other_indices.end(); entry++) {
+    indices.push_back(*entry - first + base);
+    values.push_back(other_values[entry - other_indices.begin()]);
+  }
+}
+
+// Replaces the entries of tokens [first, last) with those of `fresh`, whose
+// token indices start at 0, and re-indexes the entries after them
+template <typename T>
+static void side_table_splice(std::vector<uint32_t> &indices,
+                              std::vector<T> &values, size_t first,
+                              size_t last,
+                              const std::vector<uint32_t> &fresh_indices,
+                              const std::vector<T> &fresh_values,
+                              size_t fresh_count) {
+  size_t from = std::lower_bound(indices.begin(), indices.end(), first) -
+                indices.begin();
+  size_t to = std::lower_bound(indices.begin() + from, indices.end(), last) -
+              indices.begin();
+
+  long delta = static_cast<long>(fresh_count) - (last - first);
+  for (size_t i = to; i < indices.size(); i++) {
+    indices[i] += delta;
+  }
+
+  std::vector<uint32_t> placed(fresh_indices);
+  for (auto &index : placed) {
+    index += first;
+  }
+
+  indices.erase(indices.begin() + from, indices.begin() + to);
+  indices.insert(indices.begin() + from, placed.begin(), placed.end());
+  values.erase(values.begin() + from, values.begin() + to);
+  values.insert(values.begin() + from, fresh_values.begin(),
+                fresh_values.end());
+}
+
+/* TokenList methods */
+TokenList::TokenList(std::string_view source,
+                     std::shared_ptr<StringArena> strings)
+    : source(source), strings(strings ? std::move(strings)
+                                      : std::make_shared<StringArena>()) {}
+
+void TokenList::push_back(TokenType kind, size_t start) {
+  kinds.push_back(kind);
+  starts.push_back(static_cast<uint32_t>(start));
+}
+
+void TokenList::push_back(TokenType kind, size_t start,
+                          const NumberValue &number) {
+  number_tokens.push_back(kinds.size());
+  numbers.push_back(number);
+  push_back(kind, start);
+}
+
+void TokenList::push_back(TokenType kind, size_t start,
+                          std::string_view text) {
+  text_tokens.push_back(kinds.size());
+  texts.push_back(text);
+  push_back(kind, start);
+}
+
+void TokenList::append(const TokenList &other, size_t first) {
+  side_table_append(number_tokens, numbers, other.number_tokens,
+                    other.numbers, first, kinds.size());
+  side_table_append(text_tokens, texts, other.text_tokens, other.texts,
+                    first, kinds.size());
+  kinds.insert(kinds.end(), other.kinds.begin() + first, other.kinds.end());
+  starts.insert(starts.end(), other.starts.begin() + first,
+                other.starts.end());
+}
+
+void TokenList::reserve(size_t count) {
+  kinds.reserve(count);
+  starts.reserve(count);
+}
+
+size_t TokenList::end_of(size_t index) const {
+  return Lexer::token_end(source, kinds[index], starts[index]);
+}
+
+const std::vector<uint32_t> &TokenList::get_line_starts() const {
+  auto lines = std::atomic_load(&line_starts);
+  if (!lines) {
+    std::shared_ptr<const std::vector<uint32_t>> built =
+        std::make_shared<const std::vector<uint32_t>>(
+            vanadium::source::find_line_starts(source));
+    // Another reader may have won the race, in which case `lines` is theirs
+    if (std::atomic_compare_exchange_strong(&line_starts, &lines, built)) {
+      lines = built;
+    }
+  }
+  return *lines;
+}
+
+size_t TokenList::line_of(size_t index) const {
+  const auto &lines = get_line_starts();
+  return std::upper_bound(lines.begin(), lines.end(), starts[index]) -
+         lines.begin();
+}
+
+const NumberValue &TokenList::number_of(size_t index) const {
+  const NumberValue *number = side_table_find(number_tokens, numbers, index);
+  if (!number) {
+    throw std::out_of_range("Token has no numeric value");
+  }
+  return *number;
+}
+
+std::string_view TokenList::text_of(size_t index) const {
+  const std::string_view *text = side_table_find(text_tokens, texts, index);
+  if (text) {
+    return *text;
+  }
+  if (kinds.at(index) != TokenType::String) {
+    throw std::out_of_range("Token is not a string");
+  }
+  return make_token(source, TokenType::String, starts[index], end_of(index),
+                    0)
+      .text;
+}
+
+size_t TokenList::lower_bound(size_t offset) const {
+  return std::lower_bound(starts.begin(), starts.end(), offset) -
+         starts.begin();
+}
 
+Token TokenList::at(size_t index) const {
+  if (index >= kinds.size()) {
+    throw std::out_of_range("Token index is past the end of the list");
+  }
+  Token tk = make_token(source, kinds[index], starts[index], end_of(index),
+                        line_of(index));
+  if (tk.kind == TokenType::Int || tk.kind == TokenType::Float) {
+    tk.number = number_of(index);
+  } else if (tk.kind == TokenType::String) {
+    const std::string_view *text = side_table_find(text_tokens, texts, index);
+    if (text) {
+      tk.text = *text;
+    }
+  }
+  return tk;
+}
+
+/* Main lexer logic */
 #define NOT_OUT_OF_BOUNDS (input.size() >= index)
 #define CHECK_NEXT_INDEX (input.size() >= (index + 1))
+#define CHECK_OFFSET(OFFSET) (input.size() > (index + OFFSET))
 #define AT_INDEX input[index]
 #define AT_OFFSET(OFFSET) input[index + OFFSET]
+#define IS(CLASSES) ((classes & (CLASSES)) != 0)
+#define SLICE(FROM, TO) input.substr(FROM, (TO) - (FROM))
+#define CURSOR (input.data() + index)
+#define INPUT_END (input.data() + input.size())
+#define MOVE_TO(PTR) index = (PTR) - input.data()
+
+/* Token scanners, shared by the lexer and `Lexer::token_end()` */
+
+// Extent of a numeric literal: an optional `0x`/`0b` prefix, digits that may
+// be separated by underscores, a fraction for decimal literals, and a suffix
+// running from `suffix` to `end`
+struct NumberExtent {
+  int base;
+  bool has_fraction;
+  size_t suffix;
+  size_t end;
+};
+
+static bool is_digit_of(char c, int base) {
+  switch (base) {
+  case 2:
+    return c == '0' || c == '1';
+  case 16:
+    return char_is(c, CC_DIGIT) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+  default:
+    return char_is(c, CC_DIGIT);
+  }
+}
+
+static const char *skip_number_digits(const char *p, const char *end,
+                                      int base) {
+  while (true) {
+    if (base == 10) {
+      p = scan::skip_digits(p, end);
+    } else {
+      while (p != end && is_digit_of(*p, base)) {
+        p++;
+      }
+    }
+
+    if (p == end || *p != '_') {
+      return p;
+    }
+    p++;
+  }
+}
+
+static NumberExtent scan_number(std::string_view input, size_t from) {
+  const char *begin = input.data() + from;
+  const char *end = input.data() + input.size();
+
+  NumberExtent extent{10, false, 0, 0};
+  const char *cursor = begin;
+  if (*begin == '0' && begin + 1 != end) {
+    char prefix = begin[1] | 0x20;
+    if (prefix == 'x' || prefix == 'b') {
+      extent.base = prefix == 'x' ? 16 : 2;
+      cursor += 2;
+    }
+  }
+
+  cursor = skip_number_digits(cursor, end, extent.base);
+  if (extent.base == 10 && cursor != end && *cursor == '.') {
+    extent.has_fraction = true;
+    cursor = skip_number_digits(cursor + 1, end, 10);
+  }
+  extent.suffix = cursor - input.data();
+
+  // Digits left over after a binary literal end up in the suffix as well
+  if (cursor != end &&
+      (((*cursor | 0x20) >= 'a' && (*cursor | 0x20) <= 'z') ||
+       char_is(*cursor, CC_DIGIT) || *cursor == '_')) {
+    cursor = scan::skip_ident(cursor, end);
+  }
+  extent.end = cursor - input.data();
+  return extent;
+}
+
+// Decodes the literal at [from, extent.end) into `value`, returning its kind.
+// Malformed literals and values that do not fit their type are reported as
+// InvalidToken.
+static TokenType decode_number(std::string_view input, size_t from,
+                               const NumberExtent &extent,
+                               NumberValue &value) {
+  std::string_view text = input.substr(from, extent.end - from);
+  size_t prefix = extent.base == 10 ? 0 : 2;
+  std::string_view digits =
+      input.substr(from + prefix, extent.suffix - from - prefix);
+  std::string_view suffix =
+      input.substr(extent.suffix, extent.end - extent.suffix);
+
+  bool is_float = extent.has_fraction;
+  // Lexers resuming mid-input do not know their line, so count it here
+  auto fail = [&](const std::string &reason) {
+    size_t line = 1 + std::count(input.begin(), input.begin() + from, '\n');
+    throw parser::InvalidToken(
+        Token(is_float ? TokenType::Float : TokenType::Int, text, from,
+              extent.end, line),
+        reason);
+  };
+
+  value = NumberValue();
+  if (!suffix.empty() && char_is(suffix[0], CC_DIGIT)) {
+    fail("invalid digit '" + std::string(1, suffix[0]) + "' in literal");
+  }
+  if (!suffix.empty()) {
+    unsigned bits = 0;
+    auto width = std::from_chars(suffix.data() + 1,
+                                 suffix.data() + suffix.size(), bits);
+    bool valid_width = suffix.size() > 1 && suffix[1] != '0' &&
+                       width.ec == std::errc() &&
+                       width.ptr == suffix.data() + suffix.size();
+
+    if (valid_width && (suffix[0] == 'i' || suffix[0] == 'u') && !is_float &&
+        bits >= 1 && bits <= 64) {
+      value.is_unsigned = suffix[0] == 'u';
+    } else if (valid_width && suffix[0] == 'f' && extent.base == 10 &&
+               (bits == 32 || bits == 64)) {
+      is_float = true;
+    } else {
+      fail("unknown literal suffix '" + std::string(suffix) + "'");
+    }
+    value.bits = bits;
+  }
+
+  std::string cleaned;
+  if (digits.find('_') != std::string_view::npos) {
+    std::remove_copy(digits.begin(), digits.end(),
+                     std::back_inserter(cleaned), '_');
+    digits = cleaned;
+  }
+  if (digits.empty() || digits[0] == '.') {
+    fail("expected digits");
+  }
+
+  const char *digits_end = digits.data() + digits.size();
+  if (is_float) {
+    auto result = std::from_chars(digits.data(), digits_end, value.floating);
+    if (result.ec == std::errc::result_out_of_range) {
+      fail("float literal is out of range");
+    }
+    if (value.bits == 32 &&
+        value.floating > std::numeric_limits<float>::max()) {
+      fail("float literal overflows f32");
+    }
+    return TokenType::Float;
+  }
+
+  auto result =
+      std::from_chars(digits.data(), digits_end, value.integer, extent.base);
+  if (result.ec == std::errc::result_out_of_range) {
+    fail("integer literal does not fit in 64 bits");
+  }
+
+  // Signed literals may reach 2^(N-1), the magnitude of the type's minimum
+  if (value.bits != 0 && value.bits < 64) {
+    uint64_t max = value.is_unsigned ? (uint64_t(1) << value.bits) - 1
+                                     : uint64_t(1) << (value.bits - 1);
+    if (value.integer > max) {
+      fail("integer literal overflows " + std::string(suffix));
+    }
+  } else if (value.bits == 64 && !value.is_unsigned &&
+             value.integer > uint64_t(1) << 63) {
+    fail("integer literal overflows " + std::string(suffix));
+  }
+  return TokenType::Int;
+}
+
+// A backslash escapes the byte after it, so an escaped quote does not end the
+// string. Sets `has_escapes` if there was a backslash.
+static size_t string_end(std::string_view input, size_t from,
+                         bool &has_escapes) {
+  const char *cursor = input.data() + from + 1;
+  const char *end = input.data() + input.size();
+
+  has_escapes = false;
+  while (true) {
+    cursor = scan::find_quote_or_escape(cursor, end);
+    if (cursor == end || *cursor == '"') {
+      break;
+    }
+    has_escapes = true;
+    cursor = std::min(cursor + 2, end);
+  }
+
+  // Step over the closing quote, if the string has one
+  return (cursor == end ? cursor : cursor + 1) - input.data();
+}
+
+// Decodes the escapes of the string spanning [from, to) into `out`.
+// Unknown or malformed escapes are reported as InvalidToken.
+static void decode_string(std::string_view input, size_t from, size_t to,
+                          std::string &out) {
+  Token tk = make_token(input, TokenType::String, from, to, 0);
+  std::string_view raw = tk.lexeme;
+
+  auto fail = [&](size_t at, const std::string &reason) {
+    tk.pos.line = 1 + std::count(input.begin(), input.begin() + from, '\n');
+    throw parser::InvalidToken(tk, reason + " at offset " +
+                                       std::to_string(from + 1 + at));
+  };
+  auto hex_value = [](char c) -> int {
+    if (char_is(c, CC_DIGIT)) {
+      return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+  };
+
+  out.clear();
+  out.reserve(raw.size());
+  for (size_t i = 0; i < raw.size(); i++) {
+    if (raw[i] != '\\') {
+      out += raw[i];
+      continue;
+    }
+    if (i + 1 == raw.size()) {
+      fail(i, "unfinished escape sequence");
+    }
+
+    char escape = raw[++i];
+    switch (escape) {
+    case 'n':
+      out += '\n';
+      break;
+    case 't':
+      out += '\t';
+      break;
+    case 'r':
+      out += '\r';
+      break;
+    case '0':
+      out += '\0';
+      break;
+    case '\\':
+    case '"':
+    case '\'':
+      out += escape;
+      break;
+
+    // \xHH: one byte
+    case 'x': {
+      int high = i + 2 < raw.size() ? hex_value(raw[i + 1]) : -1;
+      int low = i + 2 < raw.size() ? hex_value(raw[i + 2]) : -1;
+      if (high < 0 || low < 0) {
+        fail(i - 1, "expected two hex digits after '\\x'");
+      }
+      out += static_cast<char>(high * 16 + low);
+      i += 2;
+      break;
+    }
+
+    // \u{H...}: a code point, encoded as UTF-8
+    case 'u': {
+      size_t close = raw.find('}', i);
+      uint32_t code = 0;
+      bool valid = i + 1 < raw.size() && raw[i + 1] == '{' &&
+                   close != std::string_view::npos && close > i + 2 &&
+                   close - i - 2 <= 6;
+      for (size_t j = i + 2; valid && j < close; j++) {
+        int digit = hex_value(raw[j]);
+        valid = digit >= 0;
+        code = code * 16 + digit;
+      }
+      if (!valid || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) {
+        fail(i - 1, "invalid '\\u{...}' escape");
+      }
+
+      if (code < 0x80) {
+        out += static_cast<char>(code);
+      } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+      } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+      } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+      }
+      i = close;
+      break;
+    }
+
+    default:
+      fail(i - 1, "unknown escape sequence '\\" + std::string(1, escape) +
+                      "'");
+    }
+  }
+}
 
-TokenStream tokenize(std::string input) {
-  TokenList tokens;
+// Identifiers continue with ASCII identifier bytes and XID_Continue code
+// points
+static size_t ident_end(std::string_view input, size_t from) {
+  const char *cursor = input.data() + from;
+  const char *end = input.data() + input.size();
 
-  size_t index = 0;
-  size_t line = 1;
+  uint32_t code;
+  cursor += std::max<size_t>(1, decode_utf8(cursor, end, code));
+  while (true) {
+    cursor = scan::skip_ident(cursor, end);
+    if (cursor == end || static_cast<unsigned char>(*cursor) < 0x80) {
+      break;
+    }
+    size_t length = decode_utf8(cursor, end, code);
+    if (length == 0 || !is_xid_continue(code)) {
+      break;
+    }
+    cursor += length;
+  }
+  return cursor - input.data();
+}
 
+// Operators are one character, or two for the comparisons, compound
+// assignments, `&&`, `||`, `<<` and `>>`
+static size_t op_end(std::string_view input, size_t from) {
+  if (from + 1 < input.size()) {
+    char first = input[from];
+    char second = input[from + 1];
+    if (second == '=' && first != '?') {
+      return from + 2;
+    }
+    if (first == second &&
+        (first == '&' || first == '|' || first == '<' || first == '>')) {
+      return from + 2;
+    }
+  }
+  return from + 1;
+}
+
+size_t Lexer::token_end(std::string_view input, TokenType kind,
+                        size_t from) {
+  switch (kind) {
+  case TokenType::EOI:
+    return from;
+  case TokenType::Int:
+  case TokenType::Float:
+    return scan_number(input, from).end;
+  case TokenType::String: {
+    bool has_escapes;
+    return string_end(input, from, has_escapes);
+  }
+  case TokenType::Op:
+    return op_end(input, from);
+  case TokenType::Punct:
+  case TokenType::EOS:
+    return from + 1;
+  default:
+    return ident_end(input, from);
+  }
+}
+
+TokenType Lexer::scan_token(size_t &from, size_t &from_line) {
   while (CHECK_NEXT_INDEX) {
-    if (AT_INDEX == '@' && CHECK_NEXT_INDEX && AT_OFFSET(1) == '@') {
+    uint8_t classes = char_classes[static_cast<unsigned char>(AT_INDEX)];
+
+    if (AT_INDEX == '@' && CHECK_OFFSET(1) && AT_OFFSET(1) == '@') {
       index += 2;
-      while (CHECK_NEXT_INDEX && AT_INDEX != '\n') {
-        index++;
-      }
+      MOVE_TO(scan::find_line_end(CURSOR, INPUT_END));
       continue;
     }
 
-    if (AT_INDEX == '@' && CHECK_NEXT_INDEX && AT_OFFSET(1) == '*') {
+    if (AT_INDEX == '@' && CHECK_OFFSET(1) && AT_OFFSET(1) == '*') {
       index += 2;
-      while (index + 1 < input.size() &&
-             !(AT_INDEX == '*' && AT_OFFSET(1) == '@')) {
-        if (AT_INDEX == '\n') {
-          line++;
-        }
-        index++;
-      }
-      if (index + 1 < input.size()) {
+      MOVE_TO(scan::find_block_comment_end(CURSOR, INPUT_END, line));
+      if (CHECK_NEXT_INDEX) {
         index += 2;
       }
       continue;
     }
 
-    if (AT_INDEX == '\n' || AT_INDEX == ' ' || AT_INDEX == '\t') {
-      if (AT_INDEX == '\n') {
-        line++;
-      }
-      index++;
+    if (IS(CC_WHITESPACE)) {
+      MOVE_TO(scan::skip_whitespace(CURSOR, INPUT_END, line));
       continue;
     }
 
-    if (std::isdigit(static_cast<unsigned char>(AT_INDEX))) {
-      int from = index;
-      TokenType final_type;
-      std::string buf(1, AT_INDEX);
-      index++;
+    from = index;
+    from_line = line;
 
-      while (CHECK_NEXT_INDEX && std::isdigit(AT_INDEX)) {
-        buf += AT_INDEX;
-        index++;
-      }
+    if (IS(CC_DIGIT)) {
+      NumberExtent extent = scan_number(input, from);
+      index = extent.end;
+      return decode_number(input, from, extent, number);
+    }
 
-      if (CHECK_NEXT_INDEX && AT_INDEX == '.') {
-        final_type = TokenType::Float;
-        buf += '.';
-        index++;
-        while (CHECK_NEXT_INDEX && std::isdigit(AT_INDEX)) {
-          buf += AT_INDEX;
-          index++;
-        }
+    if (IS(CC_QUOTE)) {
+      index = string_end(input, from, has_escapes);
+      line += std::count(input.data() + from, CURSOR, '\n');
+
+      // Strings without escapes are their own lexeme, the rest are decoded
+      // into the arena
+      if (has_escapes) {
+        std::string decoded;
+        decode_string(input, from, index, decoded);
+        text = strings->store(decoded);
       } else {
-        final_type = TokenType::Int;
+        text = std::string_view();
       }
+      return TokenType::String;
+    }
 
-      int to = index;
-      PUSH_TOKEN(Token(final_type, buf, from, to, line));
+    if (IS(CC_IDENT_START)) {
+      index = ident_end(input, from);
+      TokenType kind = TokenType::Ident;
+      lookup_keyword(SLICE(from, index), kind);
+      return kind;
     }
 
-    if (AT_INDEX == '"') {
-      int from = index;
-      std::string buf;
-      index++;
-      while (CHECK_NEXT_INDEX && AT_INDEX != '"') {
-        buf += AT_INDEX;
-        index++;
-      }
+    if (IS(CC_OP)) {
+      index = op_end(input, from);
+      return TokenType::Op;
+    }
 
+    if (IS(CC_PUNCT)) {
       index++;
-      int to = index;
-      PUSH_TOKEN(Token(TokenType::String, buf, from, to, line));
+      return TokenType::Punct;
     }
 
-    if (std::isalnum(static_cast<unsigned char>(AT_INDEX)) || AT_INDEX == '_' ||
-        AT_INDEX == '!' || AT_INDEX == '?') {
-      int from = index;
-      std::string buf(1, AT_INDEX);
+    if (IS(CC_EOS)) {
       index++;
+      return TokenType::EOS;
+    }
 
-      while (CHECK_NEXT_INDEX &&
-             (std::isalnum(static_cast<unsigned char>(AT_INDEX)) ||
-              AT_INDEX == '_' || AT_INDEX == '!' || AT_INDEX == '?')) {
-        buf += AT_INDEX;
-        index++;
+    // Non-ASCII identifiers start with an XID_Start code point
+    if (static_cast<unsigned char>(AT_INDEX) >= 0x80) {
+      uint32_t code;
+      size_t length = decode_utf8(CURSOR, INPUT_END, code);
+      if (length != 0 && is_xid_start(code)) {
+        index = ident_end(input, from);
+        return TokenType::Ident;
       }
+      throw parser::UnexpectedChar(SLICE(from, from + std::max<size_t>(
+                                                       1, length)),
+                                   index);
+    }
 
-      int to = index;
-      if (keyword_map.count(buf) > 0) {
-        PUSH_TOKEN(Token(keyword_map.at(buf), buf, from, to, line));
-      } else {
-        PUSH_TOKEN(Token(TokenType::Ident, buf, from, to, line));
+    throw parser::UnexpectedChar(AT_INDEX, index);
+  }
+
+  from = input.size();
+  from_line = line;
+  return TokenType::EOI;
+}
+
+Lexer::Lexer(std::string_view input, std::shared_ptr<StringArena> strings)
+    : Lexer(input, 0, 1, std::move(strings)) {}
+
+Lexer::Lexer(std::string_view input, size_t index, size_t line,
+             std::shared_ptr<StringArena> strings)
+    : input(input), index(index), line(line),
+      strings(strings ? std::move(strings)
+                      : std::make_shared<StringArena>()) {}
+
+TokenType Lexer::next_kind(size_t &from) {
+  size_t from_line;
+  return scan_token(from, from_line);
+}
+
+Token Lexer::next_token() {
+  size_t from, from_line;
+  TokenType kind = scan_token(from, from_line);
+  Token tk = make_token(input, kind, from, index, from_line);
+  if (kind == TokenType::Int || kind == TokenType::Float) {
+    tk.number = number;
+  } else if (kind == TokenType::String && has_escapes) {
+    tk.text = text;
+  }
+  return tk;
+}
+
+// Sources are addressed with 32-bit offsets
+static void check_size(std::string_view input) {
+  if (input.size() > UINT32_MAX) {
+    throw std::length_error("Cannot lex inputs larger than 4 GiB");
+  }
+}
+
+// Validates [from, to) of `input` as UTF-8, which must begin and end on
+// character boundaries
+static void check_encoding(std::string_view input, size_t from, size_t to) {
+  const char *bad =
+      scan::validate_utf8(input.data() + from, input.data() + to);
+  if (bad != input.data() + to) {
+    throw parser::InvalidEncoding(bad - input.data());
+  }
+}
+
+// Runs once over the whole input before lexing it
+static void check_input(std::string_view input) {
+  check_size(input);
+  check_encoding(input, 0, input.size());
+}
+
+// Appends the token `lexer` just lexed, with its value if it is a number or
+// a string with escapes
+static void push_lexed(TokenList &tokens, const Lexer &lexer, TokenType kind,
+                       size_t from) {
+  if (kind == TokenType::Int || kind == TokenType::Float) {
+    tokens.push_back(kind, from, lexer.get_number());
+  } else if (kind == TokenType::String && lexer.text_has_escapes()) {
+    tokens.push_back(kind, from, lexer.get_text());
+  } else {
+    tokens.push_back(kind, from);
+  }
+}
+
+static TokenList lex_serial(std::string_view input) {
+  TokenList tokens(input);
+  Lexer lexer(input, tokens.get_strings());
+  TokenType kind;
+
+  do {
+    size_t from;
+    kind = lexer.next_kind(from);
+    push_lexed(tokens, lexer, kind, from);
+  } while (kind != TokenType::EOI);
+
+  return tokens;
+}
+
+/* Parallel lexing */
+
+// Tokens of one chunk, lexed speculatively: the chunk's lexer starts at the
+// chunk boundary as if nothing (a comment, a string) were open there. It
+// stops before the first token starting at or past the chunk's end, or
+// before a token it failed to lex.
+struct LexedChunk {
+  size_t begin = 0;
+  size_t end = 0;
+  TokenList tokens = {};
+  size_t end_index = 0;
+  bool failed = false;
+  std::exception_ptr fatal = nullptr;
+};
+
+static void lex_chunk(std::string_view input,
+                      const std::shared_ptr<StringArena> &strings,
+                      LexedChunk &chunk) {
+  Lexer lexer(input, chunk.begin, 1, strings);
+  chunk.tokens = TokenList(input, strings);
+  chunk.end_index = chunk.begin;
+
+  try {
+    while (true) {
+      size_t from;
+      TokenType kind = lexer.next_kind(from);
+      if (kind == TokenType::EOI || from >= chunk.end) {
+        break;
       }
+      push_lexed(chunk.tokens, lexer, kind, from);
+      chunk.end_index = lexer.get_index();
     }
+  } catch (const parser::ParseError &) {
+    chunk.failed = true;
+  } catch (...) {
+    chunk.fatal = std::current_exception();
+  }
+}
 
-    if (SET_HAS(op_list, AT_INDEX)) {
-      int from = index;
-      std::string lex(1, AT_INDEX);
-      index++;
-      int to = index;
-      PUSH_TOKEN(Token(TokenType::Op, lex, from, to, line));
+static TokenList lex_parallel(std::string_view input, unsigned jobs) {
+  if (jobs == 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  std::vector<LexedChunk> chunks;
+  size_t begin = 0;
+  for (unsigned i = 0; i < jobs && begin < input.size(); i++) {
+    size_t end = input.size();
+    if (i + 1 < jobs) {
+      end = std::max(begin, input.size() / jobs * (i + 1));
+      size_t newline = input.find('\n', end);
+      end = newline == std::string_view::npos ? input.size() : newline + 1;
     }
+    chunks.push_back(LexedChunk{begin, end});
+    begin = end;
+  }
 
-    if (SET_HAS(punct_list, AT_INDEX)) {
-      int from = index;
-      std::string lex(1, AT_INDEX);
-      index++;
-      int to = index;
-      PUSH_TOKEN(Token(TokenType::Punct, lex, from, to, line));
+  if (chunks.size() <= 1) {
+    return lex_serial(input);
+  }
+
+  auto strings = std::make_shared<StringArena>();
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < chunks.size(); i++) {
+    workers.emplace_back(lex_chunk, input, std::cref(strings),
+                         std::ref(chunks[i]));
+  }
+  lex_chunk(input, strings, chunks[0]);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (const auto &chunk : chunks) {
+    if (chunk.fatal) {
+      std::rethrow_exception(chunk.fatal);
     }
+  }
 
-    if (AT_INDEX == ';') {
-      index++;
-      PUSH_TOKEN(Token(TokenType::EOS, ";", index, index, line));
+  // Stitch the chunks together with a serial lexer. Whenever it produces a
+  // token that some chunk also lexed at the same offset, both lexers are in
+  // the same state from there on: the chunk's tokens are taken as they are
+  // and the serial lexer jumps to the chunk's end. A chunk whose boundary
+  // fell inside a comment or a string is only re-lexed up to the first such
+  // token, and the serial lexer is the one raising the errors, so
+  // speculative failures are never reported.
+  size_t total = 0;
+  for (const auto &chunk : chunks) {
+    total += chunk.tokens.size();
+  }
+
+  TokenList tokens(input, strings);
+  tokens.reserve(total + 1);
+  Lexer lexer(input, strings);
+  TokenType kind = TokenType::EOI;
+  size_t from = 0;
+  bool pending = false;
+
+  for (auto &chunk : chunks) {
+    while (true) {
+      if (!pending) {
+        kind = lexer.next_kind(from);
+        pending = true;
+      }
+
+      if (kind == TokenType::EOI || from >= chunk.end) {
+        break;
+      }
+
+      size_t resync = chunk.tokens.lower_bound(from);
+      if (resync == chunk.tokens.size() ||
+          chunk.tokens.start_of(resync) != from ||
+          chunk.tokens.kind_of(resync) != kind) {
+        push_lexed(tokens, lexer, kind, from);
+        pending = false;
+        continue;
+      }
+
+      tokens.append(chunk.tokens, resync);
+      lexer = Lexer(input, chunk.end_index, 1, tokens.get_strings());
+      pending = false;
+
+      // Past a speculative failure the serial lexer finds out whether the
+      // error is real
+      if (!chunk.failed) {
+        break;
+      }
     }
+  }
 
-    throw parser::UnexpectedChar(AT_INDEX, index);
+  while (true) {
+    if (!pending) {
+      kind = lexer.next_kind(from);
+    }
+    pending = false;
+    push_lexed(tokens, lexer, kind, from);
+    if (kind == TokenType::EOI) {
+      break;
+    }
+  }
+
+  return tokens;
+}
+
+static TokenList lex(std::string_view input) {
+  check_input(input);
+  if (input.size() >= parallel_lex_threshold &&
+      std::thread::hardware_concurrency() > 1) {
+    return lex_parallel(input, 0);
+  }
+  return lex_serial(input);
+}
+
+TokenStream tokenize(std::string_view input) {
+  return TokenStream(lex(input));
+}
+
+TokenStream tokenize_parallel(std::string_view input, unsigned jobs) {
+  check_input(input);
+  return TokenStream(lex_parallel(input, jobs));
+}
+
+TokenStream tokenize(const source::SourceManager &sources,
+                     source::FileID file) {
+  return TokenStream(lex(sources.contents(file)), file);
+}
+
+/* Incremental lexing */
+
+// Line starts after replacing `removed` bytes at `offset` with `replacement`
+static std::vector<uint32_t>
+edit_line_starts(const std::vector<uint32_t> &lines, size_t offset,
+                 size_t removed, std::string_view replacement) {
+  long delta = static_cast<long>(replacement.size()) - removed;
+
+  // Lines starting inside the removed bytes are gone, and the replacement
+  // brings its own
+  auto kept = std::upper_bound(lines.begin(), lines.end(), offset);
+  auto shifted = std::upper_bound(kept, lines.end(), offset + removed);
+
+  std::vector<uint32_t> edited(lines.begin(), kept);
+  for (size_t i = 0; i < replacement.size(); i++) {
+    if (replacement[i] == '\n') {
+      edited.push_back(offset + i + 1);
+    }
+  }
+  for (auto it = shifted; it != lines.end(); it++) {
+    edited.push_back(*it + delta);
+  }
+  return edited;
+}
+
+TokenEdit relex(TokenList &tokens, std::string &source, size_t offset,
+                size_t removed, std::string_view replacement) {
+  // Tokens ending before the edit are unchanged; the one ending right at it
+  // could grow, so re-lexing starts after the last token ending before it
+  size_t first = tokens.lower_bound(offset);
+  size_t restart = 0;
+  if (first > 0) {
+    size_t end = tokens.end_of(first - 1);
+    if (end >= offset) {
+      first--;
+      restart = tokens.start_of(first);
+    } else {
+      restart = end;
+    }
+  }
+
+  // Only the bytes around the replacement can become malformed; they are
+  // checked before anything is changed
+  auto is_continuation = [](char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+  };
+  size_t before = offset;
+  while (before > 0 && offset - before < 4 && is_continuation(source[before])) {
+    before--;
+  }
+  size_t after = offset + removed;
+  while (after < source.size() && after - offset - removed < 4 &&
+         is_continuation(source[after])) {
+    after++;
+  }
+  std::string window = source.substr(before, offset - before);
+  window.append(replacement);
+  window.append(source, offset + removed, after - offset - removed);
+  try {
+    check_encoding(window, 0, window.size());
+  } catch (const parser::InvalidEncoding &err) {
+    throw parser::InvalidEncoding(before + err.get_offset());
+  }
+
+  source.replace(offset, removed, replacement);
+  std::string_view input = source;
+  check_size(input);
+  tokens.source = input;
+  if (tokens.line_starts) {
+    tokens.line_starts = std::make_shared<const std::vector<uint32_t>>(
+        edit_line_starts(*tokens.line_starts, offset, removed, replacement));
+  }
+
+  long delta = static_cast<long>(replacement.size()) - removed;
+  size_t edit_end = offset + replacement.size();
+
+  // Re-lex until a new token past the edit starts where an old one did:
+  // from there on the lexer sees the same bytes in the same state
+  Lexer lexer(input, restart, 1, tokens.strings);
+  TokenList fresh(input, tokens.strings);
+  size_t resync = tokens.size();
+  while (true) {
+    size_t from;
+    TokenType kind = lexer.next_kind(from);
+
+    if (from >= edit_end) {
+      size_t old_from = from - delta;
+      size_t old = tokens.lower_bound(old_from);
+      if (old < tokens.size() && tokens.start_of(old) == old_from &&
+          tokens.kind_of(old) == kind) {
+        resync = old;
+        break;
+      }
+    }
+
+    push_lexed(fresh, lexer, kind, from);
+    if (kind == TokenType::EOI) {
+      break;
+    }
   }
 
-  tokens.push_back(Token(TokenType::EOI, "", input.size(), input.size()));
-  return TokenStream(tokens);
+  for (size_t i = resync; i < tokens.size(); i++) {
+    tokens.starts[i] += delta;
+  }
+
+  // Splice the side tables the same way, re-indexing the entries after
+  side_table_splice(tokens.number_tokens, tokens.numbers, first, resync,
+                    fresh.number_tokens, fresh.numbers, fresh.size());
+  side_table_splice(tokens.text_tokens, tokens.texts, first, resync,
+                    fresh.text_tokens, fresh.texts, fresh.size());
+
+  size_t replaced = resync - first;
+  auto &kinds = tokens.kinds;
+  auto &starts = tokens.starts;
+  if (fresh.size() == replaced) {
+    std::copy(fresh.kinds.begin(), fresh.kinds.end(), kinds.begin() + first);
+    std::copy(fresh.starts.begin(), fresh.starts.end(),
+              starts.begin() + first);
+  } else {
+    kinds.erase(kinds.begin() + first, kinds.begin() + resync);
+    kinds.insert(kinds.begin() + first, fresh.kinds.begin(),
+                 fresh.kinds.end());
+    starts.erase(starts.begin() + first, starts.begin() + resync);
+    starts.insert(starts.begin() + first, fresh.starts.begin(),
+                  fresh.starts.end());
+  }
+
+  return TokenEdit{first, replaced, fresh.size()};
+}
+
+TokenStream stream_tokens(std::string_view input) {
+  check_input(input);
+  return TokenStream(Lexer(input));
+}
+
+TokenStream stream_tokens(const source::SourceManager &sources,
+                          source::FileID file) {
+  check_input(sources.contents(file));
+  return TokenStream(Lexer(sources.contents(file)), file);
 }
 
 /* misc. */
@@ -238,6 +1204,8 @@ std::string type_as_string(TokenType type) {
     return "Const";
   case TokenType::Static:
     return "Static";
+  case TokenType::Export:
+    return "Export";
   case TokenType::Discard:
     return "Discard";
   case TokenType::From:
@@ -272,6 +1240,10 @@ std::string type_as_string(TokenType type) {
     return "Or";
   case TokenType::Not:
     return "Not";
+  case TokenType::Sealed:
+    return "Sealed";
+  case TokenType::Comptime:
+    return "Comptime";
   case TokenType::EOS:
     return "EOS";
   case TokenType::Bool:
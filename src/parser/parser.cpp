@@ -3,19 +3,26 @@
 #include "vanadium/parser/errors.hpp"
 #include "vanadium/parser/lexer.hpp"
 #include "vanadium/parser/pmacros.hpp"
+#include "vanadium/parser/profile.hpp"
 #include "vanadium/util_macros.hpp"
 #include <algorithm>
+#include <array>
 #include <cstddef>
-#include <set>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 using TType = vanadium::lexer::TokenType;
 
-#define SHOW_RULE_STARTS
-
-#ifdef SHOW_RULE_STARTS
-#define ST_RULE(NAME) std::cout << "Starting rule '" NAME "'" << std::endl
+// Rules only carry instrumentation in VANADIUM_PARSER_PROFILE builds
+#ifdef VANADIUM_PARSER_PROFILE
+#define ST_RULE(NAME)                                                          \
+  static profile::Rule rule_stats_(NAME);                                      \
+  profile::Scope rule_scope_(rule_stats_, ts)
 #else
 #define ST_RULE(NAME)                                                          \
   do {                                                                         \
@@ -25,6 +32,15 @@ using TType = vanadium::lexer::TokenType;
 namespace vanadium {
 namespace parser {
 
+/* Nesting */
+
+void Parser::nest() {
+  if (depth >= options.max_depth) {
+    throw NestingTooDeep(ts.get(), options.max_depth);
+  }
+  depth++;
+}
+
 /* NodeStream methods */
 NodeP NodeStream::next() { return nodes.at(current++); }
 NodeP NodeStream::get() { return nodes.at(current); }
@@ -36,17 +52,35 @@ const NodeList NodeStream::get_nodes() { return nodes; }
 
 /* Main parser logic */
 NodeStream Parser::parse() {
-  std::vector<NodeP> nodes;
-  while (ts.has_next()) {
-    if (MATCH(ts.get(), TType::EOI)) {
-      break;
-    }
-    nodes.push_back(parse_start());
-    if (MATCH(ts.get(), TType::EOS)) {
-      ts.next();
+  unsigned jobs =
+      options.jobs ? options.jobs : std::thread::hardware_concurrency();
+
+  NodeList nodes;
+  if (jobs < 2 || ts.is_streaming() ||
+      ts.get_tokens().size() < parallel_parse_threshold ||
+      !parse_parallel(jobs, nodes)) {
+    nodes = parse_items();
+  }
+  return NodeStream(nodes, ts.get_strings(), arena);
+}
+
+// Parses top-level items up to the end of the stream
+NodeList Parser::parse_items() {
+  NodeList nodes;
+  try {
+    while (ts.has_next()) {
+      if (MATCH(ts.get(), TType::EOI)) {
+        break;
+      }
+      nodes.push_back(parse_statement());
+      if (MATCH(ts.get(), TType::EOS)) {
+        ts.next();
+      }
     }
+  } catch (const TooManyErrors &) {
+    gave_up = true;
   }
-  return NodeStream(nodes);
+  return nodes;
 }
 
 std::vector<lexer::TokenType> Parser::parse_modifiers() {
@@ -77,7 +111,263 @@ std::vector<lexer::TokenType> Parser::parse_modifiers() {
     }                                                                          \
   }
 
-NodeP Parser::parse_start() {
+// FIRST set of declarations: their modifiers and introducing keywords
+static bool starts_declaration(TType kind) {
+  switch (kind) {
+  case TType::Static:
+  case TType::Sealed:
+  case TType::Export:
+  case TType::Let:
+  case TType::Const:
+  case TType::Func:
+  case TType::Class:
+  case TType::Struct:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Whether a statement can start at the token after a `}` that closed a
+// top-level item, rather than that item's expression continuing there
+static bool starts_item(TType kind) {
+  return starts_declaration(kind) || kind == TType::From ||
+         kind == TType::Include;
+}
+
+// Splits tokens [first, EOI) into at most `parts` ranges of whole top-level
+// items, returning the indices bounding them. An item ends at a `;` or at a
+// `}` followed by a declaration, outside of any brackets. Returns nothing if
+// the brackets do not balance.
+static std::vector<size_t> split_items(const lexer::TokenList &tokens,
+                                       size_t first, unsigned parts) {
+  std::string_view source = tokens.get_source();
+  size_t end = tokens.size() - 1;
+
+  std::vector<size_t> bounds = {first};
+  size_t part_size = (end - first) / parts + 1;
+  size_t depth = 0;
+  bool closed_item = false;
+
+  for (size_t i = first; i < end; i++) {
+    TType kind = tokens.kind_of(i);
+
+    if (depth == 0 && i > first && i >= bounds.back() + part_size &&
+        (tokens.kind_of(i - 1) == TType::EOS ||
+         (closed_item && starts_item(kind)))) {
+      bounds.push_back(i);
+    }
+    closed_item = false;
+
+    if (kind != TType::Punct) {
+      continue;
+    }
+    switch (source[tokens.start_of(i)]) {
+    case '(':
+    case '[':
+    case '{':
+      depth++;
+      break;
+    case ')':
+    case ']':
+    case '}':
+      if (depth == 0) {
+        return {};
+      }
+      depth--;
+      closed_item = depth == 0 && source[tokens.start_of(i)] == '}';
+      break;
+    }
+  }
+
+  if (depth != 0) {
+    return {};
+  }
+  bounds.push_back(end);
+  return bounds;
+}
+
+// Parses ranges of top-level items on `jobs` threads. On any error it
+// returns false, leaving the serial parse to report it exactly.
+bool Parser::parse_parallel(unsigned jobs, NodeList &nodes) {
+  const auto &tokens = ts.share_tokens();
+  std::vector<size_t> bounds = split_items(*tokens, ts.get_index(), jobs);
+  if (bounds.size() < 3) {
+    return false;
+  }
+
+  size_t parts = bounds.size() - 1;
+  std::vector<NodeList> results(parts);
+  std::vector<std::shared_ptr<AstArena>> arenas(parts);
+  std::vector<char> succeeded(parts, false);
+
+  ParseOptions part_options = options;
+  part_options.jobs = 1;
+
+  auto parse_part = [&](size_t part) {
+    try {
+      Parser parser(lexer::TokenStream(tokens, bounds[part], bounds[part + 1],
+                                       ts.get_file()),
+                    part_options);
+      results[part] = parser.parse_items();
+      arenas[part] = parser.arena;
+      succeeded[part] = parser.errors.empty() && !parser.gave_up;
+    } catch (...) {
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t part = 1; part < parts; part++) {
+    workers.emplace_back(parse_part, part);
+  }
+  parse_part(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  for (size_t part = 0; part < parts; part++) {
+    if (!succeeded[part]) {
+      return false;
+    }
+  }
+  for (size_t part = 0; part < parts; part++) {
+    nodes.insert(nodes.end(), results[part].begin(), results[part].end());
+    arena->adopt(*arenas[part]);
+  }
+  return true;
+}
+
+// One statement and all that is nested in it. In recovery mode a syntax
+// error is recorded and the innermost statement it was found in becomes an
+// ErrorNode.
+NodeP Parser::parse_statement() {
+  ST_RULE("parse_statement");
+  return parse_nested(Start::Statement);
+}
+
+// Runs `start` and the rules nested in it as a loop over
+// `statement_frames`. A rule either finishes with its node or pushes a
+// frame and sets `start` to the rule it waits for. A finished node goes to
+// the frame on top, which then finishes in turn or starts another rule.
+NodeP Parser::parse_nested(Start start) {
+  size_t base = statement_frames.size();
+  size_t outer_depth = depth;
+
+  try {
+    NodeP node = nullptr;
+    while (true) {
+      try {
+        if (!node) {
+          node = start_rule(start);
+        } else if (statement_frames.size() > base) {
+          node = resume_statement(node, start);
+        } else {
+          return node;
+        }
+      } catch (const TooManyErrors &) {
+        throw;
+      } catch (const ParseError &err) {
+        size_t statement = statement_frames.size();
+        while (statement > base &&
+               statement_frames[statement - 1].step !=
+                   StatementFrame::Statement) {
+          statement--;
+        }
+        if (!options.recover || statement == base) {
+          throw;
+        }
+        node = recover(statement - 1, err);
+      }
+    }
+  } catch (...) {
+    statement_frames.resize(base);
+    depth = outer_depth;
+    throw;
+  }
+}
+
+// Starts `start`, returning its node if it nests nothing, or null once it
+// has pushed its frame and set `start` to what it nests
+NodeP Parser::start_rule(Start &start) {
+  switch (start) {
+  case Start::Statement: {
+    size_t outer_depth = depth;
+    nest();
+    StatementFrame &frame = statement_frames.emplace_back();
+    frame.step = StatementFrame::Statement;
+    frame.pos = here();
+    frame.mark = ts.checkpoint();
+    frame.pending_start = pending.size();
+    frame.depth = outer_depth;
+    return parse_start(start);
+  }
+  case Start::Block:
+    return open_block(start);
+  case Start::Expr:
+    return parse_expr(start);
+  }
+  return nullptr;
+}
+
+// Hands `node` to the frame on top, returning the node that frame finishes
+// with, or null once it has set `start` to the next rule it nests
+NodeP Parser::resume_statement(NodeP node, Start &start) {
+  StatementFrame &frame = statement_frames.back();
+  switch (frame.step) {
+  case StatementFrame::Statement:
+    depth--;
+    break;
+  case StatementFrame::Block:
+    pending.push_back(node);
+    if (MATCH(ts.get(), TType::EOS)) {
+      ts.next();
+    }
+    return next_in_block(start);
+  case StatementFrame::ImplicitReturn:
+    node = make<ImplicitReturnNode>(frame.pos, node);
+    break;
+  case StatementFrame::Throw:
+    node = make<ThrowNode>(frame.pos, node);
+    depth--;
+    break;
+  case StatementFrame::VarDecl:
+    node = make<VarDeclNode>(frame.pos, frame.name, node, frame.modifiers,
+                             frame.is_const, frame.is_static);
+    break;
+  case StatementFrame::FuncDecl:
+    node = make<FuncDeclNode>(frame.pos, frame.name, frame.modifiers, node,
+                              frame.params, frame.ret_type);
+    break;
+  }
+  statement_frames.pop_back();
+  return node;
+}
+
+// Drops the frames from the statement at `statement` on, which failed with
+// `err`, and skips what is left of it, returning the ErrorNode in its place
+NodeP Parser::recover(size_t statement, const ParseError &err) {
+  StatementFrame failed = statement_frames[statement];
+  statement_frames.resize(statement);
+  depth = failed.depth;
+
+  // A statement that failed on its first token must still move on
+  if (ts.get_index() == failed.mark && NMATCH(ts.get(), TType::EOI)) {
+    ts.next();
+  }
+  synchronize();
+  // Drop what the lists of the failed statement had gathered
+  pending.resize(failed.pending_start);
+
+  errors.push_back(err);
+  if (errors.size() >= options.max_errors) {
+    throw TooManyErrors(errors.size());
+  }
+  return make<ErrorNode>(failed.pos, arena->store(err.what()),
+                         err.get_offset());
+}
+
+// Starts a statement, as start_rule() does
+NodeP Parser::parse_start(Start &start) {
   ST_RULE("parse_start");
 
   if (MATCH(ts.get(), TType::From) || MATCH(ts.get(), TType::Include)) {
@@ -85,12 +375,15 @@ NodeP Parser::parse_start() {
   }
 
   if (MATCH(ts.get(), TType::Throw)) {
-    return parse_throw();
+    return open_throw(start);
   }
 
-  try {
-    return to_nodep(ImplicitReturnNode(parse_expr()));
-  } catch (const std::exception &) {
+  // Declarations and expressions start with disjoint sets of tokens
+  if (!starts_declaration(ts.get().kind) && NMATCH(ts.get(), TType::EOI)) {
+    StatementFrame &frame = statement_frames.emplace_back();
+    frame.step = StatementFrame::ImplicitReturn;
+    frame.pos = here();
+    return parse_expr(start);
   }
 
   auto modifiers = parse_modifiers();
@@ -98,18 +391,18 @@ NodeP Parser::parse_start() {
   const lexer::Token &tk = ts.get();
 
   if (MATCH(tk, TType::EOI)) {
-    return to_nodep(EOINode());
+    return make<EOINode>(here());
   }
 
   switch (tk.kind) {
   case TType::Let:
   case TType::Const:
     UNEXPECTED_SEALED();
-    return parse_vardecl(modifiers);
+    return open_vardecl(modifiers, start);
 
   case TType::Func:
     UNEXPECTED_SEALED();
-    return parse_funcdecl(modifiers);
+    return open_funcdecl(modifiers, start);
 
   case TType::Class:
     return parse_classdecl();
@@ -123,11 +416,31 @@ NodeP Parser::parse_start() {
   }
 }
 
+// Skips to where the next statement can start: past a `;`, or up to a `}`
+// or a declaration
+void Parser::synchronize() {
+  while (true) {
+    const lexer::Token &tk = ts.get();
+    if (MATCH(tk, TType::EOI) || starts_declaration(tk.kind) ||
+        (MATCH(tk, TType::Punct) && LITERAL(tk, "}"))) {
+      return;
+    }
+    bool end_of_statement = MATCH(tk, TType::EOS);
+    ts.next();
+    if (end_of_statement) {
+      return;
+    }
+  }
+}
+
 /* Declarations */
 
-NodeP Parser::parse_vardecl(std::vector<lexer::TokenType> modfs) {
+// Reads a variable declaration up to its `=` and starts its value
+NodeP Parser::open_vardecl(std::vector<lexer::TokenType> modfs,
+                           Start &start) {
   ST_RULE("parse_vardecl");
 
+  uint32_t pos = here();
   if (NMATCH(ts.get(), TType::Let) && NMATCH(ts.get(), TType::Const)) {
     throw ExpectedOneOfTokens({TType::Let, TType::Const}, ts.get());
   }
@@ -146,45 +459,118 @@ NodeP Parser::parse_vardecl(std::vector<lexer::TokenType> modfs) {
     throw ExpectedToken(TType::Ident, ts.get());
   }
 
-  std::string name = ts.get().lexeme;
+  Symbol name = ts.get().symbol;
 
   if (NLITERAL(ts.next(), "=")) {
     throw ExpectedToken("=", ts.get());
   }
   ts.next();
 
-  auto value = parse_expr();
-
-  return to_nodep(VarDeclNode(name, value, modfs, is_const, is_static));
+  StatementFrame &frame = statement_frames.emplace_back();
+  frame.step = StatementFrame::VarDecl;
+  frame.pos = pos;
+  frame.name = name;
+  frame.modifiers = arena->copy(modfs);
+  frame.is_const = is_const;
+  frame.is_static = is_static;
+  return parse_expr(start);
 }
 
-NodeP Parser::parse_funcdecl(std::vector<lexer::TokenType> modfs) {
+// Reads a function declaration up to its body and starts that, unless it
+// is deferred
+NodeP Parser::open_funcdecl(std::vector<lexer::TokenType> modfs,
+                            Start &start) {
   ST_RULE("parse_funcdecl");
 
+  uint32_t pos = here();
   if (NMATCH(ts.next(), TType::Ident)) {
     throw ExpectedToken(TType::Ident, ts.get());
   }
 
-  std::string name = ts.get().lexeme;
+  Symbol name = ts.get().symbol;
   ts.next();
 
   auto params = parse_parameters();
 
-  NodeP ret_type = to_nodep(TypeNode("void"));
+  NodeP ret_type = make<TypeNode>(pos, "void");
   if (LITERAL(ts.get(), ":")) {
     ts.next();
     ret_type = parse_type();
   }
 
-  NodeP block = parse_block();
+  if (options.lazy_bodies && !ts.is_streaming()) {
+    if (auto block = defer_block()) {
+      return make<FuncDeclNode>(pos, name, arena->copy(modfs), block,
+                                arena->copy(params), ret_type);
+    }
+  }
+
+  StatementFrame &frame = statement_frames.emplace_back();
+  frame.step = StatementFrame::FuncDecl;
+  frame.pos = pos;
+  frame.name = name;
+  frame.modifiers = arena->copy(modfs);
+  frame.params = arena->copy(params);
+  frame.ret_type = ret_type;
+  return open_block(start);
+}
+
+// Skips the block at the current token, returning how to parse it later.
+// Returns null, having skipped nothing, if its braces do not match.
+DeferredNode *Parser::defer_block() {
+  ST_RULE("defer_block");
 
-  return to_nodep(FuncDeclNode(name, modfs, block, params, ret_type));
+  const auto &tokens = ts.share_tokens();
+  size_t first = ts.get_index();
+  if (NLITERAL(ts.get(), "{")) {
+    return nullptr;
+  }
+
+  // Only the kinds and first bytes of the tokens are looked at
+  std::string_view source = tokens->get_source();
+  size_t end = tokens->size() - 1;
+  size_t depth = 0;
+  size_t last = first;
+  for (; last < end; last++) {
+    if (tokens->kind_of(last) != TType::Punct) {
+      continue;
+    }
+    char c = source[tokens->start_of(last)];
+    if (c == '{') {
+      depth++;
+    } else if (c == '}' && --depth == 0) {
+      break;
+    }
+  }
+  if (last == end) {
+    return nullptr;
+  }
+  last++;
+  ts.skip_to(last);
+
+  // Errors in the body surface when it is asked for
+  ParseOptions block_options = options;
+  block_options.jobs = 1;
+  block_options.recover = false;
+  source::FileID file = ts.get_file();
+
+  return arena->make_owned<DeferredNode>(
+      [=](const std::shared_ptr<AstArena> &block_arena) {
+        Parser parser(lexer::TokenStream(tokens, first, last, file),
+                      block_options);
+        parser.arena = block_arena;
+        NodeP block = parser.parse_block();
+        if (NMATCH(parser.ts.get(), TType::EOI)) {
+          throw UnexpectedToken(parser.ts.get(), "at end of function body");
+        }
+        return block;
+      });
 }
 
-std::vector<std::pair<std::string, NodeP>> Parser::parse_parameters() {
+std::vector<std::pair<Symbol, NodeP>> Parser::parse_parameters() {
   ST_RULE("parse_parameters");
 
-  std::vector<std::pair<std::string, NodeP>> params;
+  std::vector<std::pair<Symbol, NodeP>> params;
 
   if (NLITERAL(ts.get(), "(")) {
     throw ExpectedToken("(", ts.get());
@@ -200,7 +586,7 @@ std::vector<std::pair<std::string, NodeP>> Parser::parse_parameters() {
     if (NMATCH(ts.get(), TType::Ident)) {
       throw ExpectedToken(TType::Ident, ts.get());
     }
-    std::string name = ts.get().lexeme;
+    Symbol name = ts.get().symbol;
     ts.next();
 
     if (NLITERAL(ts.get(), ":")) {
@@ -237,41 +623,83 @@ NodeP Parser::parse_structdecl() {
 
 /* Expressions */
 
+// Array and map types wait on `type_frames` for the types they hold
 NodeP Parser::parse_type() {
   ST_RULE("parse_type");
 
-  bool is_const = false;
-  bool is_comptime = false;
-  bool is_reference = false;
-  bool is_throwable = false;
-  bool is_nullable = false;
+  size_t base = type_frames.size();
+  size_t outer_depth = depth;
+  try {
+    TypeNode *node = nullptr;
+    while (true) {
+      if (!node) {
+        node = start_type();
+        continue;
+      }
+      if (type_frames.size() == base) {
+        return node;
+      }
+
+      TypeFrame &frame = type_frames.back();
+      if (frame.step == TypeFrame::Key) {
+        if (NLITERAL(ts.get(), "}")) {
+          throw ExpectedToken("}", ts.get());
+        }
+        ts.next();
+        frame.step = TypeFrame::Value;
+        frame.key = node;
+        node = nullptr;
+        continue;
+      }
+
+      TypeNode *outer = frame.step == TypeFrame::Element
+                            ? make<TypeNode>(frame.pos, frame.size, node)
+                            : make<TypeNode>(frame.pos, frame.key, node);
+      finish_type(outer, frame);
+      type_frames.pop_back();
+      depth--;
+      node = outer;
+    }
+  } catch (...) {
+    type_frames.resize(base);
+    depth = outer_depth;
+    throw;
+  }
+}
+
+// Reads a type's qualifiers and what follows them, returning it if it is a
+// simple type, or null once it has pushed the frame of an array or map
+TypeNode *Parser::start_type() {
+  TypeFrame type;
+  type.pos = here();
 
   while (true) {
     if (MATCH(ts.get(), TType::Const)) {
-      is_const = true;
+      type.is_const = true;
       ts.next();
     } else if (MATCH(ts.get(), TType::Comptime)) {
-      is_comptime = true;
+      type.is_comptime = true;
       ts.next();
     } else if (LITERAL(ts.get(), "&")) {
-      is_reference = true;
+      type.is_reference = true;
       ts.next();
     } else if (LITERAL(ts.get(), "!")) {
-      is_throwable = true;
+      type.is_throwable = true;
       ts.next();
     } else {
       break;
     }
   }
 
-  std::shared_ptr<TypeNode> node;
-
   if (LITERAL(ts.get(), "[")) {
     ts.next();
 
-    int size = -1;
     if (MATCH(ts.get(), TType::Int)) {
-      size = std::stoi(ts.get().lexeme);
+      if (ts.get().number.integer >
+          static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+        throw InvalidToken(ts.get(), "array size is too large");
+      }
+      type.size = static_cast<int>(ts.get().number.integer);
       ts.next();
     }
 
@@ -280,82 +708,82 @@ NodeP Parser::parse_type() {
     }
     ts.next();
 
-    auto elem_type = std::dynamic_pointer_cast<TypeNode>(parse_type());
-    if (!elem_type) {
-      throw std::runtime_error("Expected type after array size");
-    }
-
-    node = std::make_shared<TypeNode>(size, elem_type);
+    nest();
+    type.step = TypeFrame::Element;
+    type_frames.push_back(type);
+    return nullptr;
 
   } else if (LITERAL(ts.get(), "{")) {
     ts.next();
 
-    auto key_type = std::dynamic_pointer_cast<TypeNode>(parse_type());
-    if (!key_type) {
-      throw std::runtime_error("Expected key type in map");
-    }
-
-    if (NLITERAL(ts.get(), "}")) {
-      throw ExpectedToken("}", ts.get());
-    }
-    ts.next();
-
-    auto value_type = std::dynamic_pointer_cast<TypeNode>(parse_type());
-    if (!value_type) {
-      throw std::runtime_error("Expected value type in map");
-    }
-
-    node = std::make_shared<TypeNode>(key_type, value_type);
+    nest();
+    type.step = TypeFrame::Key;
+    type_frames.push_back(type);
+    return nullptr;
 
   } else if (MATCH(ts.get(), TType::Ident)) {
-    node = std::make_shared<TypeNode>(ts.get().lexeme);
+    TypeNode *node = make<TypeNode>(type.pos, ts.get().lexeme);
     ts.next();
-  } else {
-    throw UnexpectedToken(ts.get(), "at start of type");
+    finish_type(node, type);
+    return node;
   }
 
+  throw UnexpectedToken(ts.get(), "at start of type");
+}
+
+// Reads the `?` after `node`, and gives it that and the qualifiers before
+// it
+void Parser::finish_type(TypeNode *node, const TypeFrame &qualifiers) {
   if (LITERAL(ts.get(), "?")) {
-    is_nullable = true;
+    node->is_nullable = true;
     ts.next();
   }
 
-  node->is_const = is_const;
-  node->is_comptime = is_comptime;
-  node->is_reference = is_reference;
-  node->is_throwable = is_throwable;
-  node->is_nullable = is_nullable;
-
-  return node;
+  node->is_const = qualifiers.is_const;
+  node->is_comptime = qualifiers.is_comptime;
+  node->is_reference = qualifiers.is_reference;
+  node->is_throwable = qualifiers.is_throwable;
 }
 
-NodeP Parser::parse_expr() {
+// Starts an expression, as start_rule() does. Only blocks and `throw` nest
+// statements; operators nest on a stack of their own in pratt().
+NodeP Parser::parse_expr(Start &start) {
   ST_RULE("parse_expr");
 
   if (LITERAL(ts.get(), "{")) {
-    return parse_block();
+    return open_block(start);
   } else if (MATCH(ts.get(), TType::New)) {
     return parse_new();
   } else if (MATCH(ts.get(), TType::Throw)) {
-    return parse_throw();
+    return open_throw(start);
   }
 
   return pratt(PREC_LOWEST);
 }
 
-NodeP Parser::parse_throw() {
+// Reads `throw` and leaves its operand to the loop in parse_nested(), so
+// a run of them takes no native stack
+NodeP Parser::open_throw(Start &start) {
+  ST_RULE("parse_throw");
+
+  uint32_t pos = here();
   if (NMATCH(ts.get(), TType::Throw)) {
     throw ExpectedToken(TType::Throw, ts.get());
   }
+  nest();
   ts.next();
 
-  auto operand = parse_expr();
-
-  return to_nodep(ThrowNode(operand));
+  StatementFrame &frame = statement_frames.emplace_back();
+  frame.step = StatementFrame::Throw;
+  frame.pos = pos;
+  start = Start::Expr;
+  return nullptr;
 }
 
 NodeP Parser::parse_new() {
   ST_RULE("parse_new");
 
+  uint32_t pos = here();
   if (NMATCH(ts.get(), TType::New)) {
     throw ExpectedToken(TType::New, ts.get());
   }
@@ -364,177 +792,297 @@ NodeP Parser::parse_new() {
   auto type = parse_type();
 
   if (NLITERAL(ts.get(), "(")) {
-    return to_nodep(NewExprNode(type, {}));
+    return make<NewExprNode>(pos, type, ArenaSpan<NodeP>());
   }
 
   ts.next();
-  std::vector<NodeP> args;
-
-  if (NLITERAL(ts.get(), ")")) {
-    while (true) {
-      args.push_back(pratt(PREC_ASSIGNMENT));
-
-      if (LITERAL(ts.get(), ")")) {
-        break;
-      }
+  return make<NewExprNode>(pos, type, parse_arguments());
+}
 
-      if (NLITERAL(ts.get(), ",")) {
-        throw ExpectedToken(",", ts.get());
-      }
-      ts.next();
+/* Pratt */
+
+// Binding powers and forms, indexed by Operator
+const std::array<OperatorRule, operator_count> Parser::operator_rules = [] {
+  std::array<OperatorRule, operator_count> rules{};
+
+  auto prefix = [&](Operator op, OperatorForm form) {
+    rules[static_cast<size_t>(op)].prefix = PREC_PREFIX;
+    rules[static_cast<size_t>(op)].prefix_form = form;
+  };
+  auto infix = [&](Operator op, Precedence precedence, Assoc assoc,
+                   OperatorForm form) {
+    rules[static_cast<size_t>(op)].infix = precedence;
+    rules[static_cast<size_t>(op)].assoc = assoc;
+    rules[static_cast<size_t>(op)].infix_form = form;
+  };
+  auto binary = [&](std::initializer_list<Operator> ops, Precedence precedence,
+                    Assoc assoc = Assoc::Left) {
+    for (Operator op : ops) {
+      infix(op, precedence, assoc, OperatorForm::Binary);
     }
-  }
+  };
 
-  ts.next();
-  return to_nodep(NewExprNode(type, args));
+  for (Operator op : {Operator::Minus, Operator::Star, Operator::Bang,
+                      Operator::Not, Operator::Typeof, Operator::Discard,
+                      Operator::Delete, Operator::Defer}) {
+    prefix(op, OperatorForm::Unary);
+  }
+  prefix(Operator::LParen, OperatorForm::Group);
+
+  binary({Operator::Assign, Operator::PlusAssign, Operator::MinusAssign,
+          Operator::StarAssign, Operator::SlashAssign, Operator::CaretAssign,
+          Operator::AmpAssign, Operator::PipeAssign},
+         PREC_ASSIGNMENT, Assoc::Right);
+  infix(Operator::Unless, PREC_UNLESS, Assoc::Right, OperatorForm::Unless);
+  binary({Operator::Or, Operator::PipePipe}, PREC_OR);
+  binary({Operator::And, Operator::AmpAmp}, PREC_AND);
+  binary({Operator::Equal, Operator::NotEqual, Operator::Less,
+          Operator::Greater, Operator::LessEqual, Operator::GreaterEqual},
+         PREC_COMPARISON);
+  binary({Operator::Pipe}, PREC_BIT_OR);
+  binary({Operator::Caret}, PREC_BIT_XOR);
+  binary({Operator::Amp}, PREC_BIT_AND);
+  binary({Operator::ShiftLeft, Operator::ShiftRight}, PREC_SHIFT);
+  binary({Operator::Plus, Operator::Minus}, PREC_TERM);
+  binary({Operator::Star, Operator::Slash}, PREC_FACTOR);
+
+  // Postfix
+  infix(Operator::LParen, PREC_CALL, Assoc::Left, OperatorForm::Call);
+  infix(Operator::Dot, PREC_CALL, Assoc::Left, OperatorForm::Member);
+
+  return rules;
+}();
+
+const OperatorRule &Parser::rule_of(Operator op) {
+  return operator_rules[static_cast<size_t>(op)];
 }
 
-const std::set<std::string> unary_ops = {"-",      "*",     "discard", "typeof",
-                                         "delete", "defer", "not",     "throw"};
-
-static Precedence get_precedence(const lexer::Token &tk) {
-  if (LITERAL(tk, "."))
-    return PREC_CALL;
-  if (LITERAL(tk, "("))
-    return PREC_CALL;
+// An operator waiting for an operand pushes a frame on `expr_frames`, and
+// the operand is parsed at its binding power. Once no operator after the
+// operand binds tighter, the operand goes to the frame on top, which goes
+// on with the binding power it was pushed at.
+NodeP Parser::pratt(int precedence) {
+  ST_RULE("pratt");
 
-  if (tk.kind == TType::Op) {
-    if (LITERAL(tk, "="))
-      return PREC_ASSIGNMENT;
-    if (LITERAL(tk, "+") || LITERAL(tk, "-"))
-      return PREC_TERM;
-    if (LITERAL(tk, "*") || LITERAL(tk, "/"))
-      return PREC_FACTOR;
+  size_t base = expr_frames.size();
+  size_t outer_depth = depth;
+  try {
+    NodeP left = nullptr;
+    while (true) {
+      if (!left) {
+        left = parse_prefix(precedence);
+      } else if (!parse_infix(left, precedence)) {
+        if (expr_frames.size() == base) {
+          return left;
+        }
+        left = resume_expr(left, precedence);
+      }
+    }
+  } catch (...) {
+    expr_frames.resize(base);
+    depth = outer_depth;
+    throw;
   }
-
-  return PREC_LOWEST;
 }
 
-NodeP Parser::parse_prefix() {
+// A literal, or null once it has pushed the frame of a prefix operator,
+// whose operand is parsed next at `precedence`
+NodeP Parser::parse_prefix(int &precedence) {
   ST_RULE("parse_prefix");
 
-  auto tk = ts.get();
+  const lexer::Token &tk = ts.get();
+  uint32_t pos = here();
 
-  if (MATCH(tk, TType::Int) || MATCH(tk, TType::Float) ||
-      MATCH(tk, TType::String) || MATCH(tk, TType::Ident) ||
-      MATCH(tk, TType::Bool) || MATCH(tk, TType::Null)) {
+  switch (tk.kind) {
+  case TType::Int:
+  case TType::Float:
     ts.next();
-    return to_nodep(LiteralNode(tk.lexeme, tk.kind));
-  }
+    return make<LiteralNode>(pos, tk.lexeme, tk.kind, tk.number);
 
-  if (LITERAL(tk, "(")) {
+  case TType::String:
     ts.next();
-    NodeP expr = pratt(PREC_LOWEST);
-
-    if (NLITERAL(ts.get(), ")")) {
-      throw ExpectedToken(")", ts.get());
-    }
+    return make<LiteralNode>(pos, tk.text, tk.kind);
 
+  case TType::Ident:
+  case TType::Bool:
+  case TType::Null:
     ts.next();
-    return expr;
-  }
+    return make<LiteralNode>(pos, tk.lexeme, tk.kind);
 
-  if (MATCH(tk, TType::Op) && SET_HAS(unary_ops, tk.lexeme)) {
-    std::string op = tk.lexeme;
-    ts.next();
-    NodeP right = pratt(PREC_PREFIX);
-    return to_nodep(UnaryExprNode(op, right));
+  default:
+    break;
   }
 
-  throw UnexpectedToken(tk, "at start of expression");
+  Operator op = operator_of(tk);
+  const OperatorRule &rule = rule_of(op);
+  if (rule.prefix_form == OperatorForm::None) {
+    throw UnexpectedToken(tk, "at start of expression");
+  }
+  ts.next();
+  nest();
+
+  ExprFrame &frame = expr_frames.emplace_back();
+  frame.step = rule.prefix_form == OperatorForm::Group ? ExprFrame::Group
+                                                       : ExprFrame::Unary;
+  frame.op = op;
+  frame.precedence = precedence;
+  frame.pos = pos;
+  precedence = frame.step == ExprFrame::Group ? PREC_LOWEST : rule.prefix;
+  return nullptr;
 }
 
-NodeP Parser::parse_infix(NodeP left, Precedence precedence) {
-  ST_RULE("parse_infix");
-
-  lexer::Token op_token = ts.get();
-
-  if (LITERAL(op_token, "(")) {
-    ts.next();
-    std::vector<NodeP> args;
-
-    if (NLITERAL(ts.get(), ")")) {
-      while (true) {
-        args.push_back(pratt(PREC_ASSIGNMENT));
-
-        if (LITERAL(ts.get(), ")")) {
-          break;
-        }
-
-        if (NLITERAL(ts.get(), ",")) {
-          throw ExpectedToken(",", ts.get());
-        }
-        ts.next();
-      }
-    }
-
-    ts.next();
-    return to_nodep(CallExprNode(left, args));
+// Reads the operator after `left` if it binds tighter than `precedence`,
+// returning false if it does not. A postfix operator replaces `left`; one
+// with a right operand pushes its frame and sets `left` to null and
+// `precedence` to that of the operand.
+bool Parser::parse_infix(NodeP &left, int &precedence) {
+  Operator op = operator_of(ts.get());
+  const OperatorRule &rule = rule_of(op);
+  if (rule.infix <= precedence) {
+    return false;
   }
 
-  if (LITERAL(op_token, ".")) {
-    ts.next();
+  uint32_t pos = here();
+  ts.next();
 
+  ExprFrame::Step step = ExprFrame::Binary;
+  int right_precedence = rule.infix;
+  switch (rule.infix_form) {
+  case OperatorForm::Member: {
     if (NMATCH(ts.get(), TType::Ident)) {
       throw ExpectedToken(TType::Ident, ts.get());
     }
-
-    std::string member = ts.get().lexeme;
+    Symbol member = ts.get().symbol;
     ts.next();
-
-    return to_nodep(MemberAccessNode(left, member));
+    left = make<MemberAccessNode>(pos, left, member);
+    return true;
+  }
+  case OperatorForm::Call:
+    if (LITERAL(ts.get(), ")")) {
+      ts.next();
+      left = make<CallExprNode>(pos, left, ArenaSpan<NodeP>());
+      return true;
+    }
+    step = ExprFrame::Argument;
+    right_precedence = PREC_ASSIGNMENT;
+    break;
+  case OperatorForm::Unless:
+    step = ExprFrame::Unless;
+    right_precedence = rule.infix - 1;
+    break;
+  default:
+    // A right-associative operator lets an equal one bind its right operand
+    if (rule.assoc == Assoc::Right) {
+      right_precedence--;
+    }
+    break;
   }
+  nest();
+
+  ExprFrame &frame = expr_frames.emplace_back();
+  frame.step = step;
+  frame.op = op;
+  frame.precedence = precedence;
+  frame.pos = pos;
+  frame.left = left;
+  frame.first = pending.size();
+  left = nullptr;
+  precedence = right_precedence;
+  return true;
+}
 
-  if (MATCH(op_token, TType::Unless)) {
+// Hands `operand` to the frame on top, returning the node that frame
+// finishes with and setting `precedence` back to what it was pushed at, or
+// null if the frame waits for another operand at the same binding power
+NodeP Parser::resume_expr(NodeP operand, int &precedence) {
+  ExprFrame &frame = expr_frames.back();
+  NodeP node = operand;
+
+  switch (frame.step) {
+  case ExprFrame::Unary:
+    node = make<UnaryExprNode>(frame.pos, spelling_of(frame.op), operand);
+    break;
+  case ExprFrame::Group:
+    if (NLITERAL(ts.get(), ")")) {
+      throw ExpectedToken(")", ts.get());
+    }
     ts.next();
-    auto right = parse_expr();
+    break;
+  case ExprFrame::Binary:
+    node = make<BinaryExprNode>(frame.pos, frame.left, spelling_of(frame.op),
+                                operand);
+    break;
+  case ExprFrame::Unless:
     if (MATCH(ts.get(), TType::Ifso)) {
       ts.next();
-      auto ifso = parse_expr();
-      return to_nodep(UnlessExprNode(left, right, ifso));
-    } else {
-      return to_nodep(UnlessExprNode(left, right));
+      frame.step = ExprFrame::Ifso;
+      frame.right = operand;
+      return nullptr;
     }
+    node = make<UnlessExprNode>(frame.pos, frame.left, operand);
+    break;
+  case ExprFrame::Ifso:
+    node = make<UnlessExprNode>(frame.pos, frame.left, frame.right, operand);
+    break;
+  case ExprFrame::Argument:
+    pending.push_back(operand);
+    if (NLITERAL(ts.get(), ")")) {
+      if (NLITERAL(ts.get(), ",")) {
+        throw ExpectedToken(",", ts.get());
+      }
+      ts.next();
+      return nullptr;
+    }
+    ts.next();
+    node = make<CallExprNode>(frame.pos, frame.left, take_pending(frame.first));
+    break;
   }
 
-  std::string op = op_token.lexeme;
-  Precedence op_prec = get_precedence(op_token);
-  ts.next();
-
-  NodeP right = pratt(op_prec);
-  return to_nodep(BinaryExprNode(left, op, right));
+  precedence = frame.precedence;
+  expr_frames.pop_back();
+  depth--;
+  return node;
 }
 
-NodeP Parser::pratt(int precedence) {
-  ST_RULE("pratt");
+// Arguments of a call, after its `(` and up to and including its `)`
+ArenaSpan<NodeP> Parser::parse_arguments() {
+  ST_RULE("parse_arguments");
 
-  NodeP left = parse_prefix();
+  size_t first = pending.size();
 
-  while (true) {
-    lexer::Token tk = ts.get();
-    Precedence next_prec = get_precedence(tk);
+  if (NLITERAL(ts.get(), ")")) {
+    while (true) {
+      NodeP arg = pratt(PREC_ASSIGNMENT);
+      pending.push_back(arg);
 
-    if (next_prec <= precedence)
-      break;
+      if (LITERAL(ts.get(), ")")) {
+        break;
+      }
 
-    left = parse_infix(left, next_prec);
+      if (NLITERAL(ts.get(), ",")) {
+        throw ExpectedToken(",", ts.get());
+      }
+      ts.next();
+    }
   }
 
-  return left;
+  ts.next();
+  return take_pending(first);
 }
 
 NodeP Parser::parse_include() {
   ST_RULE("parse_include");
 
-  std::string from;
-  std::vector<std::string> includes = {};
+  uint32_t pos = here();
+  std::string_view from;
+  std::vector<Symbol> includes = {};
 
   if (MATCH(ts.get(), TType::From)) {
     if (NMATCH(ts.next(), TType::String)) {
       throw ExpectedToken(TType::String, ts.get());
     }
 
-    from = ts.get().lexeme;
+    from = ts.get().text;
 
     if (NMATCH(ts.next(), TType::Include)) {
       throw ExpectedToken("include", ts.get());
@@ -546,7 +1094,7 @@ NodeP Parser::parse_include() {
         throw UnexpectedEOI();
       }
 
-      auto tk = ts.get();
+      const lexer::Token &tk = ts.get();
 
       if (MATCH(tk, TType::EOS) || MATCH(tk, TType::EOI)) {
         ts.next();
@@ -554,9 +1102,9 @@ NodeP Parser::parse_include() {
       }
 
       if (LITERAL(tk, ",")) {
-        tk = ts.next();
+        ts.next();
       } else if (MATCH(tk, TType::Ident)) {
-        includes.push_back(tk.lexeme);
+        includes.push_back(tk.symbol);
         ts.next();
       } else {
         throw ExpectedToken(TType::Ident, ts.get());
@@ -567,34 +1115,55 @@ NodeP Parser::parse_include() {
       throw ExpectedToken(TType::String, ts.get());
     }
 
-    from = ts.get().lexeme;
+    from = ts.get().text;
   } else {
     throw ExpectedOneOfTokens({TType::Include, TType::From}, ts.get());
   }
 
-  return to_nodep(IncludeNode(from, includes));
+  return make<IncludeNode>(pos, from, arena->copy(includes));
 }
 
 NodeP Parser::parse_block() {
   ST_RULE("parse_block");
+  return parse_nested(Start::Block);
+}
 
+// Reads a block's `{` and starts its first statement, as start_rule() does
+NodeP Parser::open_block(Start &start) {
+  uint32_t pos = here();
   if (NLITERAL(ts.get(), "{")) {
     throw ExpectedToken("{", ts.get());
   }
   ts.next();
 
-  std::vector<NodeP> nodes;
-  while (NLITERAL(ts.get(), "}")) {
-    if (MATCH(ts.get(), TType::EOI) || LITERAL(ts.peek(1), "}")) {
-      break;
-    }
-    nodes.push_back(parse_start());
-    if (MATCH(ts.get(), TType::EOS)) {
-      ts.next();
-    }
+  StatementFrame &frame = statement_frames.emplace_back();
+  frame.step = StatementFrame::Block;
+  frame.pos = pos;
+  frame.mark = pending.size();
+  return next_in_block(start);
+}
+
+// Starts the next statement of the block on top, or finishes the block
+NodeP Parser::next_in_block(Start &start) {
+  if (NLITERAL(ts.get(), "}") && NMATCH(ts.get(), TType::EOI) &&
+      !LITERAL(ts.peek(1), "}")) {
+    start = Start::Statement;
+    return nullptr;
   }
   ts.next();
-  return to_nodep(BlockNode(nodes));
+
+  StatementFrame &frame = statement_frames.back();
+  NodeP block = make<BlockNode>(frame.pos, take_pending(frame.mark));
+  statement_frames.pop_back();
+  return block;
+}
+
+// Moves the nodes gathered since `from` into the arena
+ArenaSpan<NodeP> Parser::take_pending(size_t from) {
+  ArenaSpan<NodeP> nodes =
+      arena->copy(pending.data() + from, pending.size() - from);
+  pending.resize(from);
+  return nodes;
 }
 
 } // namespace parser
@@ -0,0 +1,102 @@
+#include "vanadium/parser/profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace vanadium {
+namespace parser {
+namespace profile {
+
+static std::atomic<bool> enabled{false};
+static std::atomic<Rule *> rules{nullptr};
+
+// Innermost rule being timed on this thread
+static thread_local Scope *innermost = nullptr;
+
+bool is_available() {
+#ifdef VANADIUM_PARSER_PROFILE
+  return true;
+#else
+  return false;
+#endif
+}
+
+void set_enabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+Rule::Rule(const char *name) : name(name) {
+  next = rules.load();
+  while (!rules.compare_exchange_weak(next, this)) {
+  }
+}
+
+Scope::Scope(Rule &rule, lexer::TokenStream &ts)
+    : rule(is_enabled() ? &rule : nullptr), ts(ts) {
+  if (!this->rule) {
+    return;
+  }
+  first_token = ts.get_index();
+  parent = innermost;
+  innermost = this;
+  start = std::chrono::steady_clock::now();
+}
+
+Scope::~Scope() {
+  if (!rule) {
+    return;
+  }
+  uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+  rule->calls.fetch_add(1, std::memory_order_relaxed);
+  rule->tokens.fetch_add(ts.get_index() - first_token,
+                         std::memory_order_relaxed);
+  rule->total_ns.fetch_add(elapsed, std::memory_order_relaxed);
+  rule->self_ns.fetch_add(elapsed - std::min(elapsed, nested_ns),
+                          std::memory_order_relaxed);
+
+  innermost = parent;
+  if (parent) {
+    parent->nested_ns += elapsed;
+  }
+}
+
+void reset() {
+  for (Rule *rule = rules.load(); rule; rule = rule->next) {
+    rule->calls = 0;
+    rule->tokens = 0;
+    rule->total_ns = 0;
+    rule->self_ns = 0;
+  }
+}
+
+void dump(std::ostream &os) {
+  std::vector<const Rule *> called;
+  for (const Rule *rule = rules.load(); rule; rule = rule->next) {
+    if (rule->calls > 0) {
+      called.push_back(rule);
+    }
+  }
+  std::sort(called.begin(), called.end(), [](const Rule *a, const Rule *b) {
+    return a->self_ns > b->self_ns;
+  });
+
+  char line[128];
+  std::snprintf(line, sizeof(line), "%-20s %12s %12s %12s %12s\n", "rule",
+                "calls", "tokens", "total ms", "self ms");
+  os << line;
+  for (const Rule *rule : called) {
+    std::snprintf(line, sizeof(line), "%-20s %12llu %12llu %12.3f %12.3f\n",
+                  rule->name,
+                  static_cast<unsigned long long>(rule->calls.load()),
+                  static_cast<unsigned long long>(rule->tokens.load()),
+                  rule->total_ns.load() / 1e6, rule->self_ns.load() / 1e6);
+    os << line;
+  }
+}
+
+} // namespace profile
+} // namespace parser
+} // namespace vanadium
@@ -0,0 +1,527 @@
+#include "vanadium/parser/scan.hpp"
+#include "vanadium/parser/charclass.hpp"
+#include "vanadium/parser/unicode.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VANADIUM_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace vanadium {
+namespace lexer {
+namespace scan {
+
+/* Scalar kernels */
+
+static const char *scalar_skip_whitespace(const char *p, const char *end,
+                                          size_t &lines) {
+  for (; p < end; p++) {
+    if (*p == '\n') {
+      lines++;
+    } else if (*p != ' ' && *p != '\t') {
+      break;
+    }
+  }
+  return p;
+}
+
+static const char *scalar_find_line_end(const char *p, const char *end) {
+  while (p < end && *p != '\n') {
+    p++;
+  }
+  return p;
+}
+
+static const char *scalar_find_block_comment_end(const char *p,
+                                                 const char *end,
+                                                 size_t &lines) {
+  for (; p < end; p++) {
+    if (*p == '*' && p + 1 < end && p[1] == '@') {
+      return p;
+    }
+    if (*p == '\n') {
+      lines++;
+    }
+  }
+  return end;
+}
+
+static const char *scalar_skip_ident(const char *p, const char *end) {
+  while (p < end && char_is(*p, CC_IDENT_CONTINUE)) {
+    p++;
+  }
+  return p;
+}
+
+static const char *scalar_skip_digits(const char *p, const char *end) {
+  while (p < end && char_is(*p, CC_DIGIT)) {
+    p++;
+  }
+  return p;
+}
+
+static const char *scalar_find_quote_or_escape(const char *p, const char *end) {
+  while (p < end && *p != '"' && *p != '\\') {
+    p++;
+  }
+  return p;
+}
+
+// Checks one non-ASCII sequence, returning the byte after it or nullptr
+static inline const char *utf8_step(const char *p, const char *end) {
+  uint32_t code;
+  size_t length = decode_utf8(p, end, code);
+  return length == 0 ? nullptr : p + length;
+}
+
+static const char *scalar_validate_utf8(const char *p, const char *end) {
+  while (p < end) {
+    // Eight ASCII bytes at a time
+    if (end - p >= 8) {
+      uint64_t word;
+      std::memcpy(&word, p, 8);
+      if ((word & 0x8080808080808080ull) == 0) {
+        p += 8;
+        continue;
+      }
+    }
+
+    if (static_cast<unsigned char>(*p) < 0x80) {
+      p++;
+      continue;
+    }
+    const char *next = utf8_step(p, end);
+    if (next == nullptr) {
+      return p;
+    }
+    p = next;
+  }
+  return p;
+}
+
+#ifdef VANADIUM_SCAN_X86
+
+/* SSE2 kernels, 16 bytes per step */
+#define TARGET_SSE2 __attribute__((target("sse2")))
+
+TARGET_SSE2
+static inline __m128i sse2_load(const char *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+TARGET_SSE2
+static inline __m128i sse2_eq(__m128i v, char c) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+TARGET_SSE2
+static inline unsigned sse2_mask(__m128i v) {
+  return static_cast<unsigned>(_mm_movemask_epi8(v));
+}
+
+// Unsigned `lo <= v <= hi`, bytewise
+TARGET_SSE2
+static inline __m128i sse2_in_range(__m128i v, char lo, char hi) {
+  __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(hi - lo)),
+                        shifted);
+}
+
+TARGET_SSE2
+static inline __m128i sse2_ident(__m128i v) {
+  __m128i digit = sse2_in_range(v, '0', '9');
+  __m128i alpha = sse2_in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+  __m128i extra = _mm_or_si128(sse2_eq(v, '_'),
+                               _mm_or_si128(sse2_eq(v, '!'), sse2_eq(v, '?')));
+  return _mm_or_si128(_mm_or_si128(digit, alpha), extra);
+}
+
+TARGET_SSE2
+static const char *sse2_skip_whitespace(const char *p, const char *end,
+                                        size_t &lines) {
+  while (end - p >= 16) {
+    __m128i v = sse2_load(p);
+    __m128i nl = sse2_eq(v, '\n');
+    __m128i ws = _mm_or_si128(nl, _mm_or_si128(sse2_eq(v, ' '),
+                                               sse2_eq(v, '\t')));
+    unsigned newlines = sse2_mask(nl);
+    unsigned stop = ~sse2_mask(ws) & 0xFFFFu;
+    if (stop != 0) {
+      unsigned idx = __builtin_ctz(stop);
+      lines += __builtin_popcount(newlines & ((1u << idx) - 1));
+      return p + idx;
+    }
+    lines += __builtin_popcount(newlines);
+    p += 16;
+  }
+  return scalar_skip_whitespace(p, end, lines);
+}
+
+TARGET_SSE2
+static const char *sse2_find_line_end(const char *p, const char *end) {
+  while (end - p >= 16) {
+    unsigned hit = sse2_mask(sse2_eq(sse2_load(p), '\n'));
+    if (hit != 0) {
+      return p + __builtin_ctz(hit);
+    }
+    p += 16;
+  }
+  return scalar_find_line_end(p, end);
+}
+
+TARGET_SSE2
+static const char *sse2_find_block_comment_end(const char *p, const char *end,
+                                               size_t &lines) {
+  // The second load looks one byte ahead for the '@' of "*@"
+  while (end - p >= 17) {
+    __m128i v = sse2_load(p);
+    __m128i next = sse2_load(p + 1);
+    unsigned hit =
+        sse2_mask(_mm_and_si128(sse2_eq(v, '*'), sse2_eq(next, '@')));
+    unsigned newlines = sse2_mask(sse2_eq(v, '\n'));
+    if (hit != 0) {
+      unsigned idx = __builtin_ctz(hit);
+      lines += __builtin_popcount(newlines & ((1u << idx) - 1));
+      return p + idx;
+    }
+    lines += __builtin_popcount(newlines);
+    p += 16;
+  }
+  return scalar_find_block_comment_end(p, end, lines);
+}
+
+TARGET_SSE2
+static const char *sse2_skip_ident(const char *p, const char *end) {
+  while (end - p >= 16) {
+    unsigned stop = ~sse2_mask(sse2_ident(sse2_load(p))) & 0xFFFFu;
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+    p += 16;
+  }
+  return scalar_skip_ident(p, end);
+}
+
+TARGET_SSE2
+static const char *sse2_skip_digits(const char *p, const char *end) {
+  while (end - p >= 16) {
+    unsigned stop =
+        ~sse2_mask(sse2_in_range(sse2_load(p), '0', '9')) & 0xFFFFu;
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+    p += 16;
+  }
+  return scalar_skip_digits(p, end);
+}
+
+TARGET_SSE2
+static const char *sse2_find_quote_or_escape(const char *p, const char *end) {
+  while (end - p >= 16) {
+    __m128i v = sse2_load(p);
+    unsigned hit = sse2_mask(_mm_or_si128(sse2_eq(v, '"'), sse2_eq(v, '\\')));
+    if (hit != 0) {
+      return p + __builtin_ctz(hit);
+    }
+    p += 16;
+  }
+  return scalar_find_quote_or_escape(p, end);
+}
+
+// Blocks without a high bit set are skipped whole; a block with one is
+// resumed after the non-ASCII sequence it starts
+TARGET_SSE2
+static const char *sse2_validate_utf8(const char *p, const char *end) {
+  while (end - p >= 16) {
+    unsigned high = sse2_mask(sse2_load(p));
+    if (high == 0) {
+      p += 16;
+      continue;
+    }
+    p += __builtin_ctz(high);
+    const char *next = utf8_step(p, end);
+    if (next == nullptr) {
+      return p;
+    }
+    p = next;
+  }
+  return scalar_validate_utf8(p, end);
+}
+
+/* AVX2 kernels, 32 bytes per step, the tails go through SSE2 */
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+TARGET_AVX2
+static inline __m256i avx2_load(const char *p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+TARGET_AVX2
+static inline __m256i avx2_eq(__m256i v, char c) {
+  return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+TARGET_AVX2
+static inline unsigned avx2_mask(__m256i v) {
+  return static_cast<unsigned>(_mm256_movemask_epi8(v));
+}
+
+TARGET_AVX2
+static inline __m256i avx2_in_range(__m256i v, char lo, char hi) {
+  __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(hi - lo)),
+                           shifted);
+}
+
+TARGET_AVX2
+static inline __m256i avx2_ident(__m256i v) {
+  __m256i digit = avx2_in_range(v, '0', '9');
+  __m256i alpha =
+      avx2_in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+  __m256i extra = _mm256_or_si256(
+      avx2_eq(v, '_'), _mm256_or_si256(avx2_eq(v, '!'), avx2_eq(v, '?')));
+  return _mm256_or_si256(_mm256_or_si256(digit, alpha), extra);
+}
+
+TARGET_AVX2
+static const char *avx2_skip_whitespace(const char *p, const char *end,
+                                        size_t &lines) {
+  while (end - p >= 32) {
+    __m256i v = avx2_load(p);
+    __m256i nl = avx2_eq(v, '\n');
+    __m256i ws = _mm256_or_si256(
+        nl, _mm256_or_si256(avx2_eq(v, ' '), avx2_eq(v, '\t')));
+    unsigned newlines = avx2_mask(nl);
+    unsigned stop = ~avx2_mask(ws);
+    if (stop != 0) {
+      unsigned idx = __builtin_ctz(stop);
+      lines += __builtin_popcount(newlines & ((1u << idx) - 1));
+      return p + idx;
+    }
+    lines += __builtin_popcount(newlines);
+    p += 32;
+  }
+  return sse2_skip_whitespace(p, end, lines);
+}
+
+TARGET_AVX2
+static const char *avx2_find_line_end(const char *p, const char *end) {
+  while (end - p >= 32) {
+    unsigned hit = avx2_mask(avx2_eq(avx2_load(p), '\n'));
+    if (hit != 0) {
+      return p + __builtin_ctz(hit);
+    }
+    p += 32;
+  }
+  return sse2_find_line_end(p, end);
+}
+
+TARGET_AVX2
+static const char *avx2_find_block_comment_end(const char *p, const char *end,
+                                               size_t &lines) {
+  while (end - p >= 33) {
+    __m256i v = avx2_load(p);
+    __m256i next = avx2_load(p + 1);
+    unsigned hit =
+        avx2_mask(_mm256_and_si256(avx2_eq(v, '*'), avx2_eq(next, '@')));
+    unsigned newlines = avx2_mask(avx2_eq(v, '\n'));
+    if (hit != 0) {
+      unsigned idx = __builtin_ctz(hit);
+      lines += __builtin_popcount(newlines & ((1u << idx) - 1));
+      return p + idx;
+    }
+    lines += __builtin_popcount(newlines);
+    p += 32;
+  }
+  return sse2_find_block_comment_end(p, end, lines);
+}
+
+TARGET_AVX2
+static const char *avx2_skip_ident(const char *p, const char *end) {
+  while (end - p >= 32) {
+    unsigned stop = ~avx2_mask(avx2_ident(avx2_load(p)));
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+    p += 32;
+  }
+  return sse2_skip_ident(p, end);
+}
+
+TARGET_AVX2
+static const char *avx2_skip_digits(const char *p, const char *end) {
+  while (end - p >= 32) {
+    unsigned stop = ~avx2_mask(avx2_in_range(avx2_load(p), '0', '9'));
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+    p += 32;
+  }
+  return sse2_skip_digits(p, end);
+}
+
+TARGET_AVX2
+static const char *avx2_find_quote_or_escape(const char *p, const char *end) {
+  while (end - p >= 32) {
+    __m256i v = avx2_load(p);
+    unsigned hit =
+        avx2_mask(_mm256_or_si256(avx2_eq(v, '"'), avx2_eq(v, '\\')));
+    if (hit != 0) {
+      return p + __builtin_ctz(hit);
+    }
+    p += 32;
+  }
+  return sse2_find_quote_or_escape(p, end);
+}
+
+TARGET_AVX2
+static const char *avx2_validate_utf8(const char *p, const char *end) {
+  while (end - p >= 32) {
+    unsigned high = avx2_mask(avx2_load(p));
+    if (high == 0) {
+      p += 32;
+      continue;
+    }
+    p += __builtin_ctz(high);
+    const char *next = utf8_step(p, end);
+    if (next == nullptr) {
+      return p;
+    }
+    p = next;
+  }
+  return sse2_validate_utf8(p, end);
+}
+
+#endif // VANADIUM_SCAN_X86
+
+/* Dispatch */
+struct Kernels {
+  Isa isa;
+  const char *(*skip_whitespace)(const char *, const char *, size_t &);
+  const char *(*find_line_end)(const char *, const char *);
+  const char *(*find_block_comment_end)(const char *, const char *, size_t &);
+  const char *(*skip_ident)(const char *, const char *);
+  const char *(*skip_digits)(const char *, const char *);
+  const char *(*find_quote_or_escape)(const char *, const char *);
+  const char *(*validate_utf8)(const char *, const char *);
+};
+
+static const Kernels scalar_kernels = {
+    Isa::Scalar, scalar_skip_whitespace, scalar_find_line_end,
+    scalar_find_block_comment_end, scalar_skip_ident, scalar_skip_digits,
+    scalar_find_quote_or_escape, scalar_validate_utf8};
+
+#ifdef VANADIUM_SCAN_X86
+static const Kernels sse2_kernels = {
+    Isa::SSE2, sse2_skip_whitespace, sse2_find_line_end,
+    sse2_find_block_comment_end, sse2_skip_ident, sse2_skip_digits,
+    sse2_find_quote_or_escape, sse2_validate_utf8};
+
+static const Kernels avx2_kernels = {
+    Isa::AVX2, avx2_skip_whitespace, avx2_find_line_end,
+    avx2_find_block_comment_end, avx2_skip_ident, avx2_skip_digits,
+    avx2_find_quote_or_escape, avx2_validate_utf8};
+#endif
+
+static const Kernels *kernels_for(Isa isa) {
+#ifdef VANADIUM_SCAN_X86
+  switch (isa) {
+  case Isa::AVX2:
+    return &avx2_kernels;
+  case Isa::SSE2:
+    return &sse2_kernels;
+  case Isa::Scalar:
+    break;
+  }
+#endif
+  return &scalar_kernels;
+}
+
+Isa detected_isa() {
+#ifdef VANADIUM_SCAN_X86
+  static const Isa isa = []() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return Isa::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return Isa::SSE2;
+    }
+    return Isa::Scalar;
+  }();
+  return isa;
+#else
+  return Isa::Scalar;
+#endif
+}
+
+static std::atomic<const Kernels *> active_kernels{nullptr};
+
+static inline const Kernels &kernels() {
+  const Kernels *active = active_kernels.load(std::memory_order_relaxed);
+  if (active == nullptr) {
+    active = kernels_for(detected_isa());
+    active_kernels.store(active, std::memory_order_relaxed);
+  }
+  return *active;
+}
+
+Isa active_isa() { return kernels().isa; }
+
+void set_isa(Isa isa) {
+  if (static_cast<int>(isa) > static_cast<int>(detected_isa())) {
+    isa = detected_isa();
+  }
+  active_kernels.store(kernels_for(isa), std::memory_order_relaxed);
+}
+
+const char *isa_name(Isa isa) {
+  switch (isa) {
+  case Isa::Scalar:
+    return "scalar";
+  case Isa::SSE2:
+    return "sse2";
+  case Isa::AVX2:
+    return "avx2";
+  }
+  return "unknown";
+}
+
+/* Entry points */
+const char *skip_whitespace(const char *p, const char *end, size_t &lines) {
+  return kernels().skip_whitespace(p, end, lines);
+}
+
+const char *find_line_end(const char *p, const char *end) {
+  return kernels().find_line_end(p, end);
+}
+
+const char *find_block_comment_end(const char *p, const char *end,
+                                   size_t &lines) {
+  return kernels().find_block_comment_end(p, end, lines);
+}
+
+const char *skip_ident(const char *p, const char *end) {
+  return kernels().skip_ident(p, end);
+}
+
+const char *skip_digits(const char *p, const char *end) {
+  return kernels().skip_digits(p, end);
+}
+
+const char *find_quote_or_escape(const char *p, const char *end) {
+  return kernels().find_quote_or_escape(p, end);
+}
+
+const char *validate_utf8(const char *p, const char *end) {
+  return kernels().validate_utf8(p, end);
+}
+
+} // namespace scan
+} // namespace lexer
+} // namespace vanadium
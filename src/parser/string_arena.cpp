@@ -0,0 +1,48 @@
+#include "vanadium/parser/string_arena.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vanadium {
+namespace lexer {
+
+std::string_view StringArena::store(std::string_view text) {
+  if (text.empty()) {
+    return std::string_view();
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  auto found = strings.find(text);
+  if (found != strings.end()) {
+    return *found;
+  }
+
+  if (text.size() > left) {
+    size_t size = std::max(chunk_size, text.size());
+    chunks.emplace_back(new char[size]);
+    cursor = chunks.back().get();
+    left = size;
+  }
+  std::memcpy(cursor, text.data(), text.size());
+  std::string_view stored(cursor, text.size());
+  cursor += text.size();
+  left -= text.size();
+  used += text.size();
+
+  strings.insert(stored);
+  return stored;
+}
+
+size_t StringArena::string_count() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return strings.size();
+}
+
+size_t StringArena::bytes_used() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return used;
+}
+
+} // namespace lexer
+} // namespace vanadium
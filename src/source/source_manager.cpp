@@ -0,0 +1,191 @@
+#include "vanadium/source/source_manager.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vanadium {
+namespace source {
+
+std::vector<uint32_t> find_line_starts(std::string_view contents) {
+  std::vector<uint32_t> starts{0};
+  const char *data = contents.data();
+  const char *cursor = data;
+  const char *end = data + contents.size();
+  while ((cursor = static_cast<const char *>(
+              std::memchr(cursor, '\n', end - cursor))) != nullptr) {
+    cursor++;
+    starts.push_back(cursor - data);
+  }
+  return starts;
+}
+
+/* SourceFile methods */
+SourceFile::SourceFile(FileID id, std::string name, const char *data,
+                       size_t size, void *mapping, size_t mapping_size,
+                       std::unique_ptr<char[]> owned)
+    : id(id), name(std::move(name)), data(data), size(size), mapping(mapping),
+      mapping_size(mapping_size), owned(std::move(owned)) {}
+
+SourceFile::~SourceFile() {
+  if (mapping != nullptr) {
+    munmap(mapping, mapping_size);
+  }
+}
+
+const std::vector<uint32_t> &SourceFile::get_line_starts() const {
+  std::call_once(lines_once, [this]() {
+    line_starts = find_line_starts(contents());
+  });
+  return line_starts;
+}
+
+size_t SourceFile::line_of(size_t offset) const {
+  const auto &starts = get_line_starts();
+  return std::upper_bound(starts.begin(), starts.end(), offset) -
+         starts.begin();
+}
+
+std::pair<size_t, size_t> SourceFile::line_col(size_t offset) const {
+  size_t line = line_of(offset);
+  return {line, offset - get_line_starts()[line - 1] + 1};
+}
+
+/* SourceManager methods */
+static std::string errno_message(const std::string &what,
+                                 const std::string &path) {
+  return what + " '" + path + "': " + std::strerror(errno);
+}
+
+FileID SourceManager::load_file(const std::string &path) {
+  if (path == "-") {
+    return load_stdin();
+  }
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw SourceError(errno_message("Cannot open", path));
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    std::string msg = errno_message("Cannot stat", path);
+    close(fd);
+    throw SourceError(msg);
+  }
+
+  if (!S_ISREG(info.st_mode) || info.st_size == 0) {
+    FileID file = load_stream(path, fd);
+    close(fd);
+    return file;
+  }
+
+  if (static_cast<uint64_t>(info.st_size) > UINT32_MAX) {
+    close(fd);
+    throw SourceError("Cannot load '" + path + "': files over 4 GiB are not "
+                      "supported");
+  }
+
+  // Reserve the file size plus the padding as zeroed anonymous memory, then
+  // map the file over the start of it. The tail of the last file page reads
+  // as zero, and so does the reserved space past it, so the contents are
+  // always followed by `padding` zero bytes without copying the file.
+  size_t size = info.st_size;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t mapping_size = (size + padding + page - 1) / page * page;
+
+  void *reserved = mmap(nullptr, mapping_size, PROT_READ,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (reserved == MAP_FAILED) {
+    std::string msg = errno_message("Cannot map", path);
+    close(fd);
+    throw SourceError(msg);
+  }
+
+  void *mapped =
+      mmap(reserved, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    std::string msg = errno_message("Cannot map", path);
+    munmap(reserved, mapping_size);
+    throw SourceError(msg);
+  }
+  madvise(mapped, size, MADV_SEQUENTIAL);
+
+  return add_file(path, static_cast<const char *>(mapped), size, reserved,
+                  mapping_size, nullptr);
+}
+
+FileID SourceManager::load_stdin() { return load_stream("<stdin>", 0); }
+
+FileID SourceManager::load_stream(const std::string &name, int fd) {
+  size_t capacity = 64 * 1024;
+  size_t size = 0;
+  std::unique_ptr<char[]> buffer(new char[capacity + padding]);
+
+  while (true) {
+    if (size == capacity) {
+      capacity *= 2;
+      std::unique_ptr<char[]> grown(new char[capacity + padding]);
+      std::memcpy(grown.get(), buffer.get(), size);
+      buffer = std::move(grown);
+    }
+
+    ssize_t count = read(fd, buffer.get() + size, capacity - size);
+    if (count == 0) {
+      break;
+    }
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw SourceError(errno_message("Cannot read", name));
+    }
+    size += count;
+  }
+
+  std::memset(buffer.get() + size, 0, padding);
+  const char *data = buffer.get();
+  return add_file(name, data, size, nullptr, 0, std::move(buffer));
+}
+
+FileID SourceManager::add_buffer(const std::string &name,
+                                 std::string_view contents) {
+  std::unique_ptr<char[]> buffer(new char[contents.size() + padding]);
+  std::memcpy(buffer.get(), contents.data(), contents.size());
+  std::memset(buffer.get() + contents.size(), 0, padding);
+  const char *data = buffer.get();
+  return add_file(name, data, contents.size(), nullptr, 0,
+                  std::move(buffer));
+}
+
+FileID SourceManager::add_file(std::string name, const char *data,
+                               size_t size, void *mapping,
+                               size_t mapping_size,
+                               std::unique_ptr<char[]> owned) {
+  FileID id(files.size());
+  files.push_back(std::make_unique<SourceFile>(id, std::move(name), data, size,
+                                               mapping, mapping_size,
+                                               std::move(owned)));
+  return id;
+}
+
+const SourceFile &SourceManager::get(FileID file) const {
+  return *files.at(file.id);
+}
+
+std::string_view SourceManager::contents(FileID file) const {
+  return get(file).contents();
+}
+
+const std::string &SourceManager::name(FileID file) const {
+  return get(file).get_name();
+}
+
+} // namespace source
+} // namespace vanadium
@@ -0,0 +1,138 @@
+#include "vanadium/symbol.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace vanadium {
+
+// The interner is split into shards picked by the hash of the name, each
+// with its own lock, table and storage. Ids encode the shard in their low
+// bits, and every shard publishes its names in fixed blocks that are never
+// moved, so `Symbol::str()` needs no lock. A small per-thread cache in front
+// of the shards lets repeated names skip the locks as well.
+
+constexpr unsigned shard_bits = 4;
+constexpr size_t shard_count = 1 << shard_bits;
+constexpr unsigned block_bits = 14;
+constexpr size_t block_size = 1 << block_bits;
+constexpr size_t max_blocks = 1024;
+constexpr size_t storage_chunk = 64 * 1024;
+constexpr size_t cache_size = 4096;
+
+static uint64_t hash_name(std::string_view name) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (char c : name) {
+    h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+struct NameHash {
+  size_t operator()(std::string_view name) const { return hash_name(name); }
+};
+
+struct Shard {
+  std::mutex lock;
+  std::unordered_map<std::string_view, uint32_t, NameHash> ids;
+  std::atomic<std::string_view *> names[max_blocks] = {};
+  uint32_t count = 0;
+
+  std::vector<std::unique_ptr<char[]>> storage;
+  char *cursor = nullptr;
+  size_t left = 0;
+
+  std::string_view store(std::string_view name) {
+    if (name.size() > left) {
+      size_t size = std::max(storage_chunk, name.size());
+      storage.emplace_back(new char[size]);
+      cursor = storage.back().get();
+      left = size;
+    }
+    std::memcpy(cursor, name.data(), name.size());
+    std::string_view stored(cursor, name.size());
+    cursor += name.size();
+    left -= name.size();
+    return stored;
+  }
+};
+
+static Shard *shards() {
+  static Shard instances[shard_count];
+  return instances;
+}
+
+struct CacheEntry {
+  uint64_t hash;
+  uint32_t id;
+};
+
+static thread_local CacheEntry cache[cache_size];
+
+static std::string_view lookup(uint32_t id) {
+  uint32_t index = id - 1;
+  Shard &shard = shards()[index & (shard_count - 1)];
+  uint32_t local = index >> shard_bits;
+  std::string_view *block =
+      shard.names[local >> block_bits].load(std::memory_order_acquire);
+  return block[local & (block_size - 1)];
+}
+
+Symbol Symbol::intern(std::string_view name) {
+  uint64_t h = hash_name(name);
+
+  CacheEntry &cached = cache[h & (cache_size - 1)];
+  if (cached.id != 0 && cached.hash == h && lookup(cached.id) == name) {
+    return Symbol(cached.id);
+  }
+
+  size_t shard_index = (h >> 32) & (shard_count - 1);
+  Shard &shard = shards()[shard_index];
+  uint32_t id;
+  {
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto found = shard.ids.find(name);
+    if (found != shard.ids.end()) {
+      id = found->second;
+    } else {
+      uint32_t local = shard.count;
+      size_t block_index = local >> block_bits;
+      if (block_index >= max_blocks) {
+        throw std::length_error("Too many distinct symbols");
+      }
+
+      std::string_view *block =
+          shard.names[block_index].load(std::memory_order_relaxed);
+      if (block == nullptr) {
+        block = new std::string_view[block_size];
+        shard.names[block_index].store(block, std::memory_order_release);
+      }
+
+      std::string_view stored = shard.store(name);
+      block[local & (block_size - 1)] = stored;
+      shard.count++;
+
+      id = ((local << shard_bits) | shard_index) + 1;
+      shard.ids.emplace(stored, id);
+    }
+  }
+
+  cached = CacheEntry{h, id};
+  return Symbol(id);
+}
+
+std::string_view Symbol::str() const {
+  if (id == 0) {
+    return std::string_view();
+  }
+  return lookup(id);
+}
+
+} // namespace vanadium
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Generates src/parser/unicode_tables.cpp, the XID_Start and XID_Continue
+ranges of the non-ASCII code points, from the Unicode database of the Python
+running it. str.isidentifier() is defined in terms of XID_Start and
+XID_Continue, so it serves as the oracle.
+
+Usage: tools/gen_unicode_tables.py > src/parser/unicode_tables.cpp
+"""
+
+import sys
+import unicodedata
+
+
+def ranges(predicate):
+    result = []
+    start = None
+    for code in range(0x80, 0x110000):
+        if predicate(code):
+            if start is None:
+                start = code
+        elif start is not None:
+            result.append((start, code - 1))
+            start = None
+    if start is not None:
+        result.append((start, 0x10FFFF))
+    return result
+
+
+def is_xid_start(code):
+    return chr(code).isidentifier()
+
+
+def is_xid_continue(code):
+    return ("a" + chr(code)).isidentifier()
+
+
+def emit(name, table):
+    print(f"const CodeRange {name}[] = {{")
+    for lo, hi in table:
+        print(f"    {{0x{lo:04X}, 0x{hi:04X}}},")
+    print("};")
+
+
+def main():
+    start = ranges(is_xid_start)
+    cont = ranges(is_xid_continue)
+
+    print("// Generated by tools/gen_unicode_tables.py from Unicode "
+          f"{unicodedata.unidata_version}.")
+    print("// Do not edit.")
+    print()
+    print('#include "vanadium/parser/unicode.hpp"')
+    print()
+    print("#include <algorithm>")
+    print("#include <iterator>")
+    print()
+    print("namespace vanadium {")
+    print("namespace lexer {")
+    print()
+    print("namespace {")
+    print()
+    print("struct CodeRange {")
+    print("  uint32_t lo;")
+    print("  uint32_t hi;")
+    print("};")
+    print()
+    emit("xid_start_ranges", start)
+    print()
+    emit("xid_continue_ranges", cont)
+    print()
+    print("template <size_t N>")
+    print("bool in_ranges(const CodeRange (&ranges)[N], uint32_t code) {")
+    print("  auto range = std::upper_bound(")
+    print("      std::begin(ranges), std::end(ranges), code,")
+    print("      [](uint32_t code, const CodeRange &r) { return code < r.lo; });")
+    print("  return range != std::begin(ranges) && code <= (range - 1)->hi;")
+    print("}")
+    print()
+    print("} // namespace")
+    print()
+    print("bool is_xid_start(uint32_t code) {")
+    print("  return in_ranges(xid_start_ranges, code);")
+    print("}")
+    print()
+    print("bool is_xid_continue(uint32_t code) {")
+    print("  return in_ranges(xid_continue_ranges, code);")
+    print("}")
+    print()
+    print("} // namespace lexer")
+    print("} // namespace vanadium")
+
+    print(f"{len(start)} XID_Start and {len(cont)} XID_Continue ranges",
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()